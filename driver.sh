@@ -4,9 +4,6 @@ if [[ -z "$1" ]]; then
 	exit 1;
 fi
 DIR="$(cd "$(dirname "$0")" && pwd -P)"
-# Below overrides the --print-ir flag if provided to the compiler
-${DIR}/lilang $@ --print-ir=a.ll && \
-llc a.ll -filetype=obj && \
+# lilang writes the object file itself and links it with the runtime
 echo "Creating executable a.out" && \
-clang ${DIR}/runtime.o a.o && \
-rm a.o a.ll
+${DIR}/lilang $@ --emit=exe --output=a.out --runtime=${DIR}/runtime.o
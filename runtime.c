@@ -1,30 +1,332 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <inttypes.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-int64_t __l_input() {
-  int64_t n;
-  scanf("%"SCNi64, &n);
-  return n;
+/* Output goes through a buffer of our own rather than stdio, which formats
+   and locks for every value. It's written out when it fills up, before
+   blocking on input, at exit and before aborting, and after each line when
+   it goes to a terminal, where a crash would otherwise lose what's been
+   printed so far. */
+static char out_buf[1 << 16];
+static size_t out_len;
+
+void __l_flush() {
+  size_t done = 0;
+  while (done < out_len) {
+    ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    done += n;
+  }
+  out_len = 0;
+}
+
+static int out_is_tty(void) {
+  static int tty = -1;
+  if (tty < 0)
+    tty = isatty(STDOUT_FILENO);
+  return tty;
+}
+
+__attribute__((destructor)) static void flush_at_exit(void) {
+  __l_flush();
+}
+
+static void out_write(const char* str, size_t len) {
+  if (len > sizeof(out_buf) - out_len) {
+    __l_flush();
+    if (len > sizeof(out_buf)) {
+      memcpy(out_buf, str, sizeof(out_buf));
+      out_len = sizeof(out_buf);
+      out_write(str + sizeof(out_buf), len - sizeof(out_buf));
+      return;
+    }
+  }
+  memcpy(out_buf + out_len, str, len);
+  out_len += len;
+}
+
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+/* formats two digits at a time */
+static void out_int(int64_t x) {
+  /* digits of INT64_MIN and its sign */
+  char digits[20];
+  if (sizeof(out_buf) - out_len < sizeof(digits))
+    __l_flush();
+  char* end = digits + sizeof(digits);
+  char* p = end;
+  uint64_t u = x < 0 ? -(uint64_t)x : (uint64_t)x;
+  while (u >= 100) {
+    p -= 2;
+    memcpy(p, digit_pairs + 2 * (u % 100), 2);
+    u /= 100;
+  }
+  if (u >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + 2 * u, 2);
+  } else {
+    *--p = '0' + u;
+  }
+  if (x < 0)
+    *--p = '-';
+  memcpy(out_buf + out_len, p, end - p);
+  out_len += end - p;
 }
 
 void __l_print_int(int64_t x) {
-  printf("%"PRIi64, x);
+  out_int(x);
 }
 
 void __l_print_string(char* str) {
-  printf("%s", str);
+  size_t len = strlen(str);
+  out_write(str, len);
+  if (memchr(str, '\n', len) && out_is_tty())
+    __l_flush();
+}
+
+/* a whole print statement: `kinds' has an 'i' for each int64_t argument
+   following it and an 's' for each string, which is followed by its length */
+void __l_print(const char* kinds, ...) {
+  va_list args;
+  int newline = 0;
+  va_start(args, kinds);
+  for (; *kinds; kinds++) {
+    if (*kinds == 'i') {
+      out_int(va_arg(args, int64_t));
+    } else {
+      const char* str = va_arg(args, const char*);
+      int64_t len = va_arg(args, int64_t);
+      out_write(str, len);
+      newline |= memchr(str, '\n', len) != NULL;
+    }
+  }
+  va_end(args);
+  if (newline && out_is_tty())
+    __l_flush();
+}
+
+static char in_buf[1 << 16];
+static size_t in_pos, in_len;
+
+/* the next character of the input without consuming it, EOF at its end */
+static int in_peek(void) {
+  if (in_pos == in_len) {
+    ssize_t n;
+    /* whatever asked for the input should be on the screen first */
+    __l_flush();
+    do {
+      n = read(STDIN_FILENO, in_buf, sizeof(in_buf));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+      return EOF;
+    in_pos = 0;
+    in_len = n;
+  }
+  return (unsigned char)in_buf[in_pos];
+}
+
+static int in_digit(int c, int base) {
+  int d = c >= '0' && c <= '9' ? c - '0'
+        : c >= 'a' && c <= 'z' ? c - 'a' + 10
+        : c >= 'A' && c <= 'Z' ? c - 'A' + 10
+        : base;
+  return d < base ? d : -1;
+}
+
+/* an integer the way scanf's %i reads one: decimal, or hex after 0x and octal
+   after a 0; 0 if there's none */
+int64_t __l_input() {
+  int c;
+  while ((c = in_peek()) != EOF && isspace(c))
+    in_pos++;
+
+  int negative = c == '-';
+  if (c == '-' || c == '+') {
+    in_pos++;
+    c = in_peek();
+  }
+
+  int base = 10;
+  if (c == '0') {
+    in_pos++;
+    c = in_peek();
+    base = 8;
+    if (c == 'x' || c == 'X') {
+      in_pos++;
+      c = in_peek();
+      base = 16;
+    }
+  }
+
+  uint64_t n = 0;
+  int d;
+  while (c != EOF && (d = in_digit(c, base)) >= 0) {
+    n = n * base + d;
+    in_pos++;
+    c = in_peek();
+  }
+  return negative ? -(int64_t)n : (int64_t)n;
 }
 
 void __l_abort() {
+  __l_flush();
+  abort();
+}
+
+void __l_out_of_bounds(int64_t line) {
+  __l_flush();
+  fprintf(stderr, "array index out of bounds on line %"PRIi64"\n", line);
   abort();
 }
 
+/* the interpreter's `^'; compiled code has its own, see CreatePow */
 uint64_t __l_pow(uint64_t x, uint64_t n) {
   uint64_t result = 1;
-  while (n--) {
-    result *= x;
+  while (n) {
+    if (n & 1)
+      result *= x;
+    x *= x;
+    n >>= 1;
   }
   return result;
 }
+
+/* Arrays too big for the stack live in the arena: memory mapped in chunks and
+   handed out like a stack, so the block declaring an array releases it along
+   with everything allocated after it. */
+typedef struct arena_chunk {
+  struct arena_chunk* prev;
+  char* end;
+  /* everything from here on is untouched since it was mapped, and so zero */
+  char* clean;
+} arena_chunk;
+
+/* alignment of what the arena hands out; the chunk header is padded to it */
+#define ARENA_ALIGN ((size_t)64)
+#define ARENA_CHUNK_SIZE ((size_t)64 << 20)
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+/* dirty memory at least this big is zeroed by giving its pages back */
+#define ARENA_DROP_SIZE ((size_t)1 << 20)
+
+static arena_chunk* arena_current;
+static char* arena_top;
+/* a chunk of ARENA_CHUNK_SIZE kept after its arrays were released, so that a
+   loop declaring a big array doesn't map and unmap memory every iteration */
+static arena_chunk* arena_spare;
+
+static void arena_unmap(arena_chunk* chunk) {
+  munmap(chunk, chunk->end - (char*)chunk);
+}
+
+/* maps a chunk with room for `size' bytes, aligned to huge pages so that the
+   kernel can back it with them */
+static void arena_grow(size_t size) {
+  arena_chunk* chunk;
+  if (size <= ARENA_CHUNK_SIZE - ARENA_ALIGN && arena_spare) {
+    chunk = arena_spare;
+    arena_spare = NULL;
+  } else {
+    size_t len = size + ARENA_ALIGN;
+    if (len < size || len > SIZE_MAX - 2 * HUGE_PAGE_SIZE) {
+      __l_flush();
+      fprintf(stderr, "out of memory allocating an array of %zu bytes\n", size);
+      abort();
+    }
+    len = len < ARENA_CHUNK_SIZE ? ARENA_CHUNK_SIZE : (len + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    char* mem = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+      __l_flush();
+      fprintf(stderr, "out of memory allocating an array of %zu bytes\n", size);
+      abort();
+    }
+    char* start = (char*)(((uintptr_t)mem + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (start != mem)
+      munmap(mem, start - mem);
+    if (start + len != mem + len + HUGE_PAGE_SIZE)
+      munmap(start + len, mem + HUGE_PAGE_SIZE - start);
+#ifdef MADV_HUGEPAGE
+    madvise(start, len, MADV_HUGEPAGE);
+#endif
+    chunk = (arena_chunk*)start;
+    chunk->end = start + len;
+    chunk->clean = start + ARENA_ALIGN;
+  }
+  chunk->prev = arena_current;
+  arena_current = chunk;
+  arena_top = (char*)chunk + ARENA_ALIGN;
+}
+
+/* zeroes [from, to) of the current chunk. The OS supplies the pages nothing
+   was written to yet as zero pages on first touch, so only what an earlier
+   array left behind costs anything, and the pages of a big array are only
+   paid for once the program writes to them. */
+static void arena_zero(char* from, char* to) {
+  arena_chunk* chunk = arena_current;
+  char* dirty_end = to < chunk->clean ? to : chunk->clean;
+  if (from < dirty_end) {
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    char* first = (char*)(((uintptr_t)from + page_size - 1) & ~(uintptr_t)(page_size - 1));
+    char* last = (char*)((uintptr_t)dirty_end & ~(uintptr_t)(page_size - 1));
+    if ((size_t)(dirty_end - from) >= ARENA_DROP_SIZE && madvise(first, last - first, MADV_DONTNEED) == 0) {
+      memset(from, 0, first - from);
+      memset(last, 0, dirty_end - last);
+    } else {
+      memset(from, 0, dirty_end - from);
+    }
+  }
+  if (to > chunk->clean)
+    chunk->clean = to;
+}
+
+/* zeroed memory for `count' elements of `elem_size' bytes */
+void* __l_arena_alloc(int64_t count, int64_t elem_size) {
+  if (count < 0) {
+    __l_flush();
+    fprintf(stderr, "array of negative size %"PRIi64"\n", count);
+    abort();
+  }
+  if ((uint64_t)count > (SIZE_MAX - ARENA_ALIGN) / (uint64_t)elem_size) {
+    __l_flush();
+    fprintf(stderr, "out of memory allocating an array of %"PRIi64" elements\n", count);
+    abort();
+  }
+  size_t size = ((size_t)count * elem_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (!arena_current || (size_t)(arena_current->end - arena_top) < size)
+    arena_grow(size);
+  char* mem = arena_top;
+  arena_top += size;
+  arena_zero(mem, arena_top);
+  return mem;
+}
+
+/* where the arena is at, to release everything allocated after it later */
+void* __l_arena_mark() {
+  return arena_top;
+}
+
+void __l_arena_release(void* mark) {
+  char* top = mark;
+  while (arena_current && !(top > (char*)arena_current && top <= arena_current->end)) {
+    arena_chunk* chunk = arena_current;
+    arena_current = chunk->prev;
+    if (!arena_spare && chunk->end - (char*)chunk == ARENA_CHUNK_SIZE)
+      arena_spare = chunk;
+    else
+      arena_unmap(chunk);
+  }
+  arena_top = top;
+}
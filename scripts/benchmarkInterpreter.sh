@@ -0,0 +1,9 @@
+#!/bin/bash
+# ackermann(3, 10) in the interpreter only versus compiled at -O0
+eval "./lilang benchmarks/ackermann.lil -O0 --emit=exe --output=ack.out --runtime=runtime.o &> /dev/null"
+echo "interpreter"
+printf "3 10\n" | /usr/bin/time -f "%e" ./lilang --interpret --jit-threshold=0 benchmarks/ackermann.lil > /dev/null
+echo "---------"
+echo "-O0"
+printf "3 10\n" | /usr/bin/time -f "%e" ./ack.out > /dev/null
+echo "---------"
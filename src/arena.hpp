@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Fixed size array whose storage lives in an Arena.
+template <typename T>
+class ArenaArray {
+    T* _data = nullptr;
+    size_t _size = 0;
+
+    public:
+    ArenaArray() = default;
+    ArenaArray(T* data, size_t size) : _data(data), _size(size) { }
+
+    T* begin() const { return _data; }
+    T* end() const { return _data + _size; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    T& operator[](size_t idx) const { return _data[idx]; }
+    T& back() const { return _data[_size - 1]; }
+};
+
+// Bump allocator for objects that all die together. Objects are never freed
+// one by one and their destructors never run; dropping the arena just releases
+// its blocks. So only put objects in here that don't own any other memory.
+class Arena {
+    static constexpr size_t BlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    char* _cur = nullptr;
+    char* _end = nullptr;
+
+    static char* alignUp(char* p, size_t align) {
+        uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char*>((addr + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    void* allocateSlow(size_t size, size_t align) {
+        // big objects get a block of their own so the current block isn't wasted
+        size_t blockSize = size + align > BlockSize / 4 ? size + align : BlockSize;
+        _blocks.emplace_back(new char[blockSize]);
+        char* block = _blocks.back().get();
+        char* p = alignUp(block, align);
+        if (blockSize == BlockSize) {
+            _cur = p + size;
+            _end = block + blockSize;
+        }
+        return p;
+    }
+
+    public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        if (_cur) {
+            char* p = alignUp(_cur, align);
+            if (size <= static_cast<size_t>(_end - p)) {
+                _cur = p + size;
+                return p;
+            }
+        }
+        return allocateSlow(size, align);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    ArenaArray<T> copy(const std::vector<T>& vec) {
+        if (vec.empty())
+            return ArenaArray<T>();
+        T* data = static_cast<T*>(allocate(sizeof(T) * vec.size(), alignof(T)));
+        for (size_t i = 0; i < vec.size(); i++)
+            new (data + i) T(vec[i]);
+        return ArenaArray<T>(data, vec.size());
+    }
+};
@@ -0,0 +1,130 @@
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#include "backend.hpp"
+
+static llvm::CodeGenOpt::Level codegenOptLevel(unsigned optLevel)
+{
+    switch (optLevel) {
+        case 0:  return llvm::CodeGenOpt::None;
+        case 1:  return llvm::CodeGenOpt::Less;
+        case 2:  return llvm::CodeGenOpt::Default;
+        default: return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+std::unique_ptr<llvm::TargetMachine> Lilang::createHostTargetMachine(unsigned optLevel, std::string& err)
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, err);
+    if (!target)
+        return nullptr;
+
+    llvm::SubtargetFeatures features;
+    llvm::StringMap<bool> hostFeatures;
+    if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+        for (auto& feature : hostFeatures)
+            features.AddFeature(feature.first(), feature.second);
+    }
+
+    std::unique_ptr<llvm::TargetMachine> tm(
+        target->createTargetMachine(triple, llvm::sys::getHostCPUName(), features.getString(),
+                                    llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None,
+                                    codegenOptLevel(optLevel)));
+    if (!tm)
+        err = "cannot create target machine for " + triple;
+    return tm;
+}
+
+void Lilang::configureModule(llvm::Module& module, llvm::TargetMachine& tm)
+{
+    module.setTargetTriple(tm.getTargetTriple().str());
+    module.setDataLayout(tm.createDataLayout());
+}
+
+void Lilang::optimizeModule(llvm::Module& module, llvm::TargetMachine* tm, unsigned optLevel)
+{
+    if (optLevel == 0) {
+        // what the call graph picked to inline is inlined regardless
+        llvm::legacy::PassManager modulePasses;
+        modulePasses.add(llvm::createAlwaysInlinerLegacyPass());
+        modulePasses.run(module);
+        return;
+    }
+
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel = optLevel;
+    builder.SizeLevel = 0;
+    builder.Inliner = llvm::createFunctionInliningPass(optLevel, 0, false);
+    builder.LoopVectorize = optLevel > 1;
+    builder.SLPVectorize = optLevel > 1;
+    if (tm)
+        tm->adjustPassManager(builder);
+
+    llvm::legacy::FunctionPassManager fnPasses(&module);
+    llvm::legacy::PassManager modulePasses;
+    if (tm) {
+        fnPasses.add(llvm::createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+        modulePasses.add(llvm::createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+    }
+    builder.populateFunctionPassManager(fnPasses);
+    builder.populateModulePassManager(modulePasses);
+
+    fnPasses.doInitialization();
+    for (llvm::Function& func : module)
+        fnPasses.run(func);
+    fnPasses.doFinalization();
+
+    modulePasses.run(module);
+}
+
+bool Lilang::emitObjectFile(llvm::Module& module, llvm::TargetMachine& tm,
+                            const std::string& path, std::string& err)
+{
+    std::error_code errc;
+    llvm::raw_fd_ostream out(path, errc, llvm::sys::fs::F_None);
+    if (errc) {
+        err = "cannot open " + path + ": " + errc.message();
+        return false;
+    }
+
+    llvm::legacy::PassManager passes;
+    if (tm.addPassesToEmitFile(passes, out, nullptr, llvm::TargetMachine::CGFT_ObjectFile)) {
+        err = "target can't emit object files";
+        return false;
+    }
+    passes.run(module);
+    out.flush();
+    return true;
+}
+
+bool Lilang::linkExecutable(const std::string& object, const std::string& runtime,
+                            const std::string& output, std::string& err)
+{
+    llvm::ErrorOr<std::string> cc = llvm::sys::findProgramByName("cc");
+    if (!cc) {
+        err = "cannot find cc to link with";
+        return false;
+    }
+
+    llvm::StringRef args[] = {*cc, object, runtime, "-o", output};
+    int rc = llvm::sys::ExecuteAndWait(*cc, args, llvm::None, {}, 0, 0, &err);
+    if (rc != 0 && err.empty())
+        err = "linking " + output + " failed";
+    return rc == 0;
+}
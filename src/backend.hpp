@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+namespace Lilang {
+    // Target machine for the host, tuned for the host CPU. Returns nullptr and
+    // sets `err' if the host target isn't available.
+    std::unique_ptr<llvm::TargetMachine> createHostTargetMachine(unsigned optLevel, std::string& err);
+
+    // makes `module' target `tm'; should be done before any IR is generated
+    void configureModule(llvm::Module& module, llvm::TargetMachine& tm);
+
+    // Runs the standard -O`optLevel' pipeline over `module'. With a target
+    // machine the passes get its cost model, which the vectorizers need. At
+    // -O0 only the functions marked alwaysinline are inlined.
+    void optimizeModule(llvm::Module& module, llvm::TargetMachine* tm, unsigned optLevel);
+
+    // writes `module' as an object file for `tm' to `path'
+    bool emitObjectFile(llvm::Module& module, llvm::TargetMachine& tm,
+                        const std::string& path, std::string& err);
+
+    // Links `object' with the runtime into the executable `output'. The system
+    // compiler driver is run once to do it, as it knows where libc and the C
+    // startup files are.
+    bool linkExecutable(const std::string& object, const std::string& runtime,
+                        const std::string& output, std::string& err);
+}
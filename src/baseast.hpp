@@ -8,8 +8,13 @@
 #include <llvm/IR/Value.h>
 
 #include "consts.hpp"
+#include "arena.hpp"
+#include "interner.hpp"
 #include "visitor.hpp"
 
+// All nodes are allocated in the arena of the AST::Program they belong to and
+// are never deleted on their own, so they must not own any memory: children are
+// plain pointers, lists are ArenaArrays and names are interned Symbols.
 namespace AST {
     class BaseStmt {
         public:
@@ -21,18 +26,18 @@ namespace AST {
     class FnParam {
         public:
         Token type;
-        std::string name;
+        Symbol name;
     };
 
     class FunctionPrototype {
         public:
         Token fnType;
-        std::string fnName;
-        std::vector<FnParam> fnParams;
+        Symbol fnName;
+        ArenaArray<FnParam> fnParams;
 
         FunctionPrototype(int fnType,
-                          std::string& name,
-                          std::vector<FnParam>& params)
+                          Symbol name,
+                          ArenaArray<FnParam> params)
             : fnType(static_cast<Token>(fnType)),
               fnName(name),
               fnParams(params) { }
@@ -40,72 +45,78 @@ namespace AST {
 
     class FunctionDefinition {
         public:
-        std::unique_ptr<FunctionPrototype> proto;
-        std::unique_ptr<StmtBlockStmt> body;
+        FunctionPrototype* proto;
+        StmtBlockStmt* body;
+        // whether it calls itself in tail position, see TailCall::Self
+        bool selfTailCalls = false;
+        // decided by the CallGraphVisitor: small functions calling no other
+        // are inlined into every caller, and other small ones get a copy per
+        // set of constant arguments they're called with
+        bool alwaysInline = false;
+        bool specialize = false;
 
-        FunctionDefinition(std::unique_ptr<FunctionPrototype> proto,
-                           std::unique_ptr<StmtBlockStmt> body)
-            : proto(std::move(proto)), body(std::move(body)) { }
+        FunctionDefinition(FunctionPrototype* proto,
+                           StmtBlockStmt* body)
+            : proto(proto), body(body) { }
 
         void print();
     };
 
     class Program {
         public:
-        std::vector<std::unique_ptr<AST::FunctionDefinition>> fnDefinitions;
+        // owns every node of the program
+        Arena arena;
+        std::vector<AST::FunctionDefinition*> fnDefinitions;
     };
 
-    class BaseValue {
-        public:
-        virtual ~BaseValue() = default;
-
-        virtual bool isArrayValue() { return false; }
-        virtual bool isIntValue() { return false; }
-        virtual bool isBoolValue() { return false; }
-        virtual bool isStringValue() { return false; }
-        virtual bool isVoidValue() { return false; }
-
-        virtual Token getType() { return Token::Type_void; }
-    };
+    // type of the value an expression evaluates to, filled in by the typechecker
+    class ValueType {
+        Token _type = Token::Err;
 
-    class StringValue : public BaseValue {
         public:
-        bool isStringValue() override { return true; }
-        Token getType() override { return Token::Literal_string; }
-    };
+        ValueType() = default;
+        explicit ValueType(Token type) : _type(type) { }
 
-    class ArrayValue : public BaseValue {
-        public:
-        bool isArrayValue() override { return true; }
-        Token getType() override { return Token::Type_array; }
-    };
+        bool isArrayValue() const { return _type == Token::Type_array; }
+        bool isIntValue() const { return _type == Token::Type_int; }
+        bool isBoolValue() const { return _type == Token::Type_bool; }
+        bool isStringValue() const { return _type == Token::Literal_string; }
+        bool isVoidValue() const { return _type == Token::Type_void; }
 
-    class BoolValue : public BaseValue {
-        public:
-        bool isBoolValue() override { return true; }
-        Token getType() override { return Token::Type_bool; }
+        Token getType() const { return _type; }
     };
 
-    class IntValue : public BaseValue {
-        public:
-        bool isIntValue() override { return true; }
-        Token getType() override { return Token::Type_int; }
-    };
+    ValueType createValue(Token type);
 
-    class VoidValue : public BaseValue {
-        public:
-        bool isVoidValue() override { return true; }
-        Token getType() override { return Token::Type_void; }
+    // how an array access is guarded against going out of bounds, decided by
+    // the BoundsCheckVisitor; every access is checked where it happens without it
+    enum class BoundsCheck : uint8_t {
+        // compared against the size of the array right before the access
+        Full,
+        // compared once in front of the loop the access doesn't change in, see
+        // WhileStmt::hoistedChecks
+        Hoisted,
+        // proven to be in bounds
+        None
     };
 
-    std::unique_ptr<BaseValue> createValue(Token type);
+    // how a call in tail position, `return f(...)', is made, decided by the
+    // TailCallVisitor; other calls are always ordinary ones
+    enum class TailCall : uint8_t {
+        None,
+        // reuses the frame of the caller when the prototypes match
+        Sibling,
+        // to the function it's in: assigns the parameters and jumps back to
+        // the start, so that the recursion runs in constant stack
+        Self
+    };
 
     // various types of statements
     class BaseExpr : public BaseStmt {
         public:
-        std::unique_ptr<BaseValue> result;
-        BaseExpr(std::unique_ptr<BaseValue> result)
-            : result(std::move(result)) { }
+        ValueType result;
+        BaseExpr(ValueType result)
+            : result(result) { }
         BaseExpr() {}
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
@@ -114,15 +125,17 @@ namespace AST {
     // expr -> [ID]
     class IdExpr : public BaseExpr {
         public:
-        std::string name;
-        IdExpr(std::string& name) : name(name) { }
+        Symbol name;
+        IdExpr(Symbol name) : name(name) { }
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     // stmt -> { stmt* }
     class StmtBlockStmt : public BaseStmt {
         public:
-        std::vector<std::unique_ptr<AST::BaseStmt>> stmt_list;
+        ArenaArray<AST::BaseStmt*> stmt_list;
+        StmtBlockStmt(ArenaArray<AST::BaseStmt*> stmt_list)
+            : stmt_list(stmt_list) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
@@ -130,35 +143,37 @@ namespace AST {
     class VarDecl {
         public:
         Token type;
-        std::string name;
+        Symbol name;
     };
 
     class ArrayExpr;
     // array id[expr]
     class ArrayDecl {
         public:
-        std::string name;
-        std::unique_ptr<BaseExpr> expr;
+        Symbol name;
+        BaseExpr* expr;
     };
 
     class VarDeclStmt : public BaseStmt {
         public:
-        std::vector<VarDecl> decls;
+        ArenaArray<VarDecl> decls;
+        VarDeclStmt(ArenaArray<VarDecl> decls) : decls(decls) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class ArrayDeclStmt : public BaseStmt {
         public:
-        std::vector<ArrayDecl> decls;
+        ArenaArray<ArrayDecl> decls;
+        ArrayDeclStmt(ArenaArray<ArrayDecl> decls) : decls(decls) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class PrintStmt : public BaseStmt {
         public:
-        std::vector<std::unique_ptr<BaseExpr>> args;
-        PrintStmt(std::vector<std::unique_ptr<BaseExpr>>& vec);
+        ArenaArray<BaseExpr*> args;
+        PrintStmt(ArenaArray<BaseExpr*> args) : args(args) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
@@ -167,62 +182,66 @@ namespace AST {
 
     class IfStmt : public BaseStmt {
         public:
-        std::unique_ptr<BaseExpr> cond;
-        std::unique_ptr<StmtBlockStmt> trueStmt;
-        std::unique_ptr<StmtBlockStmt> falseStmt;
-        IfStmt(std::unique_ptr<BaseExpr>& cond,
-               std::unique_ptr<StmtBlockStmt>& trueStmt,
-               std::unique_ptr<StmtBlockStmt>& falseStmt)
-               : cond(std::move(cond))
-               , trueStmt(std::move(trueStmt))
-               , falseStmt(std::move(falseStmt)) { }
+        BaseExpr* cond;
+        StmtBlockStmt* trueStmt;
+        StmtBlockStmt* falseStmt;
+        IfStmt(BaseExpr* cond,
+               StmtBlockStmt* trueStmt,
+               StmtBlockStmt* falseStmt)
+               : cond(cond)
+               , trueStmt(trueStmt)
+               , falseStmt(falseStmt) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class WhileStmt : public BaseStmt {
         public:
-        std::unique_ptr<BaseExpr> cond;
-        std::unique_ptr<StmtBlockStmt> body;
+        BaseExpr* cond;
+        StmtBlockStmt* body;
+        // accesses in the loop whose bounds checks are evaluated before entering it
+        ArenaArray<BaseStmt*> hoistedChecks;
         public:
-        WhileStmt(std::unique_ptr<BaseExpr>& cond,
-                  std::unique_ptr<StmtBlockStmt>& body)
-                  : cond(std::move(cond))
-                  , body(std::move(body)) { }
+        WhileStmt(BaseExpr* cond,
+                  StmtBlockStmt* body)
+                  : cond(cond)
+                  , body(body) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class ForStmt : public BaseStmt {
         public:
-        std::unique_ptr<BaseExpr> ident;
-        std::unique_ptr<BaseExpr> container;
-        std::unique_ptr<StmtBlockStmt> body;
+        BaseExpr* ident;
+        BaseExpr* container;
+        StmtBlockStmt* body;
+        // see WhileStmt::hoistedChecks
+        ArenaArray<BaseStmt*> hoistedChecks;
         public:
-        ForStmt(std::unique_ptr<BaseExpr>& ident,
-                std::unique_ptr<BaseExpr>& container,
-                std::unique_ptr<StmtBlockStmt>& body)
-                : ident(std::move(ident))
-                , container(std::move(container))
-                , body(std::move(body)) { }
+        ForStmt(BaseExpr* ident,
+                BaseExpr* container,
+                StmtBlockStmt* body)
+                : ident(ident)
+                , container(container)
+                , body(body) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class ReturnStmt : public BaseStmt {
         public:
-        std::unique_ptr<BaseExpr> returnExpr;
+        BaseExpr* returnExpr;
         public:
-        ReturnStmt(std::unique_ptr<BaseExpr>& returnExpr)
-                    : returnExpr(std::move(returnExpr)) { }
+        ReturnStmt(BaseExpr* returnExpr)
+                    : returnExpr(returnExpr) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class AbortStmt : public BaseStmt {
         public:
-        std::vector<std::unique_ptr<BaseExpr>> args;
-        AbortStmt(std::vector<std::unique_ptr<BaseExpr>>& vec);
+        ArenaArray<BaseExpr*> args;
+        AbortStmt(ArenaArray<BaseExpr*> args) : args(args) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
@@ -230,16 +249,19 @@ namespace AST {
     class ArrayAssignment : public BaseStmt {
         public:
         // name[idxExpr] = expr
-        std::string name;
-        std::unique_ptr<BaseExpr> idxExpr;
-        std::unique_ptr<BaseExpr> expr;
-        public:
-        ArrayAssignment(std::string& name,
-                        std::unique_ptr<BaseExpr>& idxExpr,
-                        std::unique_ptr<BaseExpr>& expr)
+        Symbol name;
+        // line of the source it's on, reported when it's out of bounds
+        int line = 0;
+        BaseExpr* idxExpr;
+        BaseExpr* expr;
+        BoundsCheck boundsCheck = BoundsCheck::Full;
+        public:
+        ArrayAssignment(Symbol name,
+                        BaseExpr* idxExpr,
+                        BaseExpr* expr)
                         : name(name)
-                        , idxExpr(std::move(idxExpr))
-                        , expr(std::move(expr)) { }
+                        , idxExpr(idxExpr)
+                        , expr(expr) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
@@ -247,13 +269,13 @@ namespace AST {
     class VarAssignment : public BaseStmt {
         public:
         // name = expr
-        std::string name;
-        std::unique_ptr<BaseExpr> expr;
+        Symbol name;
+        BaseExpr* expr;
         public:
-        VarAssignment(std::string& name,
-                      std::unique_ptr<BaseExpr>& expr)
+        VarAssignment(Symbol name,
+                      BaseExpr* expr)
                       : name(name)
-                      , expr(std::move(expr)) { }
+                      , expr(expr) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
@@ -282,38 +304,39 @@ namespace AST {
 
     class StringLiteralExpr : public BaseExpr {
         public:
-        std::string val;
-        StringLiteralExpr(std::string& name)
-            : val(name) { }
+        Symbol val;
+        StringLiteralExpr(Symbol val)
+            : val(val) { }
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class TernaryExpr : public BaseExpr {
         public:
-        std::unique_ptr<BaseExpr> condExpr;
-        std::unique_ptr<BaseExpr> trueExpr;
-        std::unique_ptr<BaseExpr> falseExpr;
-        TernaryExpr(std::unique_ptr<BaseExpr> condExpr,
-                    std::unique_ptr<BaseExpr> trueExpr,
-                    std::unique_ptr<BaseExpr> falseExpr)
-                    : condExpr(std::move(condExpr))
-                    , trueExpr(std::move(trueExpr))
-                    , falseExpr(std::move(falseExpr)) { }
+        BaseExpr* condExpr;
+        BaseExpr* trueExpr;
+        BaseExpr* falseExpr;
+        TernaryExpr(BaseExpr* condExpr,
+                    BaseExpr* trueExpr,
+                    BaseExpr* falseExpr)
+                    : condExpr(condExpr)
+                    , trueExpr(trueExpr)
+                    , falseExpr(falseExpr) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class BinopExpr : public BaseExpr {
         public:
-        std::unique_ptr<BaseExpr> leftExpr;
+        // declared first so that it fits in BaseExpr's tail padding
         Token op;
-        std::unique_ptr<BaseExpr> rightExpr;
-        BinopExpr(std::unique_ptr<BaseExpr> leftExpr,
+        BaseExpr* leftExpr;
+        BaseExpr* rightExpr;
+        BinopExpr(BaseExpr* leftExpr,
                   Token op,
-                  std::unique_ptr<BaseExpr> rightExpr)
-                  : leftExpr(std::move(leftExpr))
-                  , op(op)
-                  , rightExpr(std::move(rightExpr)) { }
+                  BaseExpr* rightExpr)
+                  : op(op)
+                  , leftExpr(leftExpr)
+                  , rightExpr(rightExpr) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
@@ -321,22 +344,22 @@ namespace AST {
     class UnaryExpr : public BaseExpr {
         public:
         Token type;
-        std::unique_ptr<BaseExpr> expr;
+        BaseExpr* expr;
         // (type expr)
         UnaryExpr(Token type,
-                  std::unique_ptr<BaseExpr>& expr)
+                  BaseExpr* expr)
                   : type(type)
-                  , expr(std::move(expr)) { }
+                  , expr(expr) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     class SizeofExpr : public BaseExpr {
         public:
-        std::unique_ptr<AST::BaseExpr> idExpr;
+        BaseExpr* idExpr;
         public:
-        SizeofExpr(std::unique_ptr<BaseExpr>& idExpr)
-            : idExpr(std::move(idExpr)) { }
+        SizeofExpr(BaseExpr* idExpr)
+            : idExpr(idExpr) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
@@ -349,23 +372,31 @@ namespace AST {
     // expr -> arr[expr]
     class ArrayExpr : public BaseExpr {
         public:
-        std::string name;
-        std::unique_ptr<BaseExpr> expr;
+        // declared first so that it fits in BaseExpr's tail padding
+        BoundsCheck boundsCheck = BoundsCheck::Full;
+        Symbol name;
+        // see ArrayAssignment::line
+        int line = 0;
+        BaseExpr* expr;
         public:
-        ArrayExpr(std::string name, std::unique_ptr<BaseExpr> expr)
+        ArrayExpr(Symbol name, BaseExpr* expr)
                 : name(name)
-                , expr(std::move(expr)) { }
+                , expr(expr) { }
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
 
     // expr -> fun(bool a, int b)
     class FnCallExpr : public BaseExpr {
         public:
-        std::string name; // fn name
-        std::vector<std::unique_ptr<BaseExpr>> fnArgs;
+        // declared first so that it fits in BaseExpr's tail padding
+        TailCall tailCall = TailCall::None;
+        Symbol name; // fn name
+        ArenaArray<BaseExpr*> fnArgs;
         public:
-        FnCallExpr(std::string name,
-                   std::vector<std::unique_ptr<BaseExpr>>& fnArgs1);
+        FnCallExpr(Symbol name,
+                   ArenaArray<BaseExpr*> fnArgs)
+                   : name(name)
+                   , fnArgs(fnArgs) { }
 
         void accept(Visitor::BaseVisitor* v) override { v->visit(this); }
     };
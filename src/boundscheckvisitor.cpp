@@ -0,0 +1,702 @@
+#include <algorithm>
+#include <climits>
+
+#include "utils.hpp"
+#include "baseast.hpp"
+#include "visitor.hpp"
+
+namespace {
+    // a + b, clamped to [min, max]
+    int64_t clampedAdd(int64_t a, int64_t b, int64_t min, int64_t max)
+    {
+        int64_t res;
+        if (__builtin_add_overflow(a, b, &res))
+            return b > 0 ? max : min;
+        return std::max(min, std::min(max, res));
+    }
+
+    // a - b, clamped to [min, max]
+    int64_t clampedSub(int64_t a, int64_t b, int64_t min, int64_t max)
+    {
+        int64_t res;
+        if (__builtin_sub_overflow(a, b, &res))
+            return b < 0 ? max : min;
+        return std::max(min, std::min(max, res));
+    }
+
+    // the facts below both `a' and `b' with the weaker distance of the two
+    std::vector<std::pair<Symbol, int64_t>> commonBelow(const std::vector<std::pair<Symbol, int64_t>>& a,
+                                                        const std::vector<std::pair<Symbol, int64_t>>& b)
+    {
+        std::vector<std::pair<Symbol, int64_t>> res;
+        auto ia = a.begin(), ib = b.begin();
+        while (ia != a.end() && ib != b.end()) {
+            if (ia->first < ib->first) {
+                ++ia;
+            } else if (ib->first < ia->first) {
+                ++ib;
+            } else {
+                res.push_back({ia->first, std::min(ia->second, ib->second)});
+                ++ia;
+                ++ib;
+            }
+        }
+        return res;
+    }
+
+    // the facts below `a' or `b' with the stronger distance of the two
+    std::vector<std::pair<Symbol, int64_t>> allBelow(const std::vector<std::pair<Symbol, int64_t>>& a,
+                                                     const std::vector<std::pair<Symbol, int64_t>>& b)
+    {
+        std::vector<std::pair<Symbol, int64_t>> res;
+        auto ia = a.begin(), ib = b.begin();
+        while (ia != a.end() || ib != b.end()) {
+            if (ib == b.end() || (ia != a.end() && ia->first < ib->first)) {
+                res.push_back(*ia++);
+            } else if (ia == a.end() || ib->first < ia->first) {
+                res.push_back(*ib++);
+            } else {
+                res.push_back({ia->first, std::max(ia->second, ib->second)});
+                ++ia;
+                ++ib;
+            }
+        }
+        return res;
+    }
+}
+
+Visitor::BoundsCheckVisitor::Linear Visitor::BoundsCheckVisitor::linear(AST::BaseExpr* expr) const
+{
+    Linear res;
+    if (auto numExpr = dynamic_cast<AST::NumExpr*>(expr)) {
+        if (numExpr->val >= _min && numExpr->val <= _max) {
+            res.kind = Linear::Const;
+            res.offset = numExpr->val;
+        }
+    } else if (auto idExpr = dynamic_cast<AST::IdExpr*>(expr)) {
+        if (idExpr->result.isIntValue()) {
+            res.kind = Linear::Var;
+            res.sym = idExpr->name;
+        }
+    } else if (auto sizeofExpr = dynamic_cast<AST::SizeofExpr*>(expr)) {
+        if (auto arrId = dynamic_cast<AST::IdExpr*>(sizeofExpr->idExpr)) {
+            res.kind = Linear::Size;
+            res.sym = arrId->name;
+        }
+    } else if (auto binopExpr = dynamic_cast<AST::BinopExpr*>(expr)) {
+        if (binopExpr->op != Token::Op_add && binopExpr->op != Token::Op_minus)
+            return res;
+        Linear lhs = linear(binopExpr->leftExpr);
+        Linear rhs = linear(binopExpr->rightExpr);
+        int64_t offset;
+        if (rhs.kind == Linear::Const) {
+            res = lhs;
+            offset = rhs.offset;
+            if (binopExpr->op == Token::Op_minus) {
+                if (offset == INT64_MIN)
+                    return Linear();
+                offset = -offset;
+            }
+        } else if (lhs.kind == Linear::Const && binopExpr->op == Token::Op_add) {
+            res = rhs;
+            offset = lhs.offset;
+        } else {
+            return Linear();
+        }
+        if (res.kind == Linear::Unknown)
+            return res;
+
+        // only as long as the addition can't wrap around
+        Range range = rangeOf(res);
+        int64_t lo, hi;
+        if (__builtin_add_overflow(range.lower, offset, &lo) || lo < _min ||
+            __builtin_add_overflow(range.upper, offset, &hi) || hi > _max ||
+            __builtin_add_overflow(res.offset, offset, &res.offset))
+            return Linear();
+    }
+    return res;
+}
+
+Visitor::BoundsCheckVisitor::Range Visitor::BoundsCheckVisitor::rangeOf(const Linear& value) const
+{
+    Range res = anyValue();
+    switch (value.kind) {
+        case Linear::Unknown:
+            return res;
+        case Linear::Const:
+            return Range{value.offset, value.offset, {}};
+        case Linear::Var:
+        {
+            auto range = _state.ranges.find(value.sym);
+            if (range != _state.ranges.end())
+                res = range->second;
+            auto sizeVar = _state.sizeVars.find(value.sym);
+            if (sizeVar != _state.sizeVars.end()) {
+                res.lower = std::max<int64_t>(res.lower, 0);
+                res.below = allBelow(res.below, {{sizeVar->second, -1}});
+            }
+        }
+        break;
+        case Linear::Size:
+        {
+            // sizes are taken to be at least 0: an array declared with a
+            // negative size has no memory to protect anyway
+            res = Range{0, _max, {{value.sym, -1}}};
+            auto size = _state.sizes.find(value.sym);
+            if (size != _state.sizes.end())
+                res.lower = res.upper = size->second;
+        }
+        break;
+    }
+
+    res.lower = clampedAdd(res.lower, value.offset, _min, _max);
+    res.upper = clampedAdd(res.upper, value.offset, _min, _max);
+    std::vector<std::pair<Symbol, int64_t>> below;
+    for (auto& fact : res.below) {
+        int64_t dist;
+        if (!__builtin_sub_overflow(fact.second, value.offset, &dist))
+            below.push_back({fact.first, dist});
+    }
+    res.below = std::move(below);
+    return res;
+}
+
+void Visitor::BoundsCheckVisitor::narrow(Symbol var, const Range& range)
+{
+    auto it = _state.ranges.emplace(var, anyValue()).first;
+    Range& cur = it->second;
+    cur.lower = std::max(cur.lower, range.lower);
+    cur.upper = std::min(cur.upper, range.upper);
+    cur.below = allBelow(cur.below, range.below);
+    if (cur.lower > cur.upper)
+        _state.reachable = false;
+    else if (cur == anyValue())
+        _state.ranges.erase(it);
+}
+
+void Visitor::BoundsCheckVisitor::join(State& into, const State& other) const
+{
+    if (!other.reachable)
+        return;
+    if (!into.reachable) {
+        into = other;
+        return;
+    }
+
+    for (auto it = into.ranges.begin(); it != into.ranges.end();) {
+        auto otherRange = other.ranges.find(it->first);
+        if (otherRange == other.ranges.end()) {
+            it = into.ranges.erase(it);
+            continue;
+        }
+        Range& range = it->second;
+        range.lower = std::min(range.lower, otherRange->second.lower);
+        range.upper = std::max(range.upper, otherRange->second.upper);
+        range.below = commonBelow(range.below, otherRange->second.below);
+        if (range == anyValue())
+            it = into.ranges.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = into.sizeVars.begin(); it != into.sizeVars.end();) {
+        auto otherSize = other.sizeVars.find(it->first);
+        if (otherSize == other.sizeVars.end() || otherSize->second != it->second)
+            it = into.sizeVars.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = into.sizes.begin(); it != into.sizes.end();) {
+        auto otherSize = other.sizes.find(it->first);
+        if (otherSize == other.sizes.end() || otherSize->second != it->second)
+            it = into.sizes.erase(it);
+        else
+            ++it;
+    }
+}
+
+void Visitor::BoundsCheckVisitor::widen(State& next, const State& prev) const
+{
+    for (auto it = next.ranges.begin(); it != next.ranges.end();) {
+        Range& range = it->second;
+        auto prevRange = prev.ranges.find(it->first);
+        if (prevRange == prev.ranges.end()) {
+            ++it;
+            continue;
+        }
+        if (range.lower < prevRange->second.lower)
+            range.lower = _min;
+        if (range.upper > prevRange->second.upper)
+            range.upper = _max;
+        std::vector<std::pair<Symbol, int64_t>> below;
+        for (auto& fact : range.below) {
+            auto prevFact = std::find(prevRange->second.below.begin(), prevRange->second.below.end(), fact);
+            if (prevFact != prevRange->second.below.end())
+                below.push_back(fact);
+        }
+        range.below = std::move(below);
+        if (range == anyValue())
+            it = next.ranges.erase(it);
+        else
+            ++it;
+    }
+}
+
+void Visitor::BoundsCheckVisitor::assume(AST::BaseExpr* cond, bool truth)
+{
+    if (!_state.reachable)
+        return;
+
+    if (dynamic_cast<AST::TrueExpr*>(cond)) {
+        _state.reachable = truth;
+    } else if (dynamic_cast<AST::FalseExpr*>(cond)) {
+        _state.reachable = !truth;
+    } else if (auto unaryExpr = dynamic_cast<AST::UnaryExpr*>(cond)) {
+        if (unaryExpr->type == Token::Op_bang)
+            assume(unaryExpr->expr, !truth);
+    } else if (auto binopExpr = dynamic_cast<AST::BinopExpr*>(cond)) {
+        AST::BaseExpr* lhs = binopExpr->leftExpr;
+        AST::BaseExpr* rhs = binopExpr->rightExpr;
+        switch (binopExpr->op) {
+            case Token::Op_and:
+                if (truth) {
+                    assume(lhs, true);
+                    assume(rhs, true);
+                }
+                break;
+            case Token::Op_or:
+                if (!truth) {
+                    assume(lhs, false);
+                    assume(rhs, false);
+                }
+                break;
+            case Token::Op_lt:
+                truth ? assumeLess(lhs, rhs, true) : assumeLess(rhs, lhs, false);
+                break;
+            case Token::Op_lte:
+                truth ? assumeLess(lhs, rhs, false) : assumeLess(rhs, lhs, true);
+                break;
+            case Token::Op_gt:
+                truth ? assumeLess(rhs, lhs, true) : assumeLess(lhs, rhs, false);
+                break;
+            case Token::Op_gte:
+                truth ? assumeLess(rhs, lhs, false) : assumeLess(lhs, rhs, true);
+                break;
+            case Token::Op_eqeq:
+            case Token::Op_neq:
+                if (truth == (binopExpr->op == Token::Op_eqeq)) {
+                    assumeLess(lhs, rhs, false);
+                    assumeLess(rhs, lhs, false);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void Visitor::BoundsCheckVisitor::assumeLess(AST::BaseExpr* left, AST::BaseExpr* right, bool strict)
+{
+    Linear lhs = linear(left);
+    Linear rhs = linear(right);
+    // both sides are computed before narrowing either
+    Range lhsRange = rangeOf(lhs);
+    Range rhsRange = rangeOf(rhs);
+
+    // var + o < right, so var <= right - o - 1
+    if (lhs.kind == Linear::Var) {
+        Range bound = anyValue();
+        bound.upper = clampedSub(clampedSub(rhsRange.upper, lhs.offset, _min, _max), strict, _min, _max);
+        for (auto& fact : rhsRange.below) {
+            int64_t dist;
+            if (!__builtin_add_overflow(fact.second, lhs.offset, &dist) &&
+                !__builtin_add_overflow(dist, static_cast<int64_t>(strict), &dist))
+                bound.below.push_back({fact.first, dist});
+        }
+        narrow(lhs.sym, bound);
+    }
+    // left < var + o, so var >= left - o + 1
+    if (rhs.kind == Linear::Var) {
+        Range bound = anyValue();
+        bound.lower = clampedAdd(clampedSub(lhsRange.lower, rhs.offset, _min, _max), strict, _min, _max);
+        narrow(rhs.sym, bound);
+    }
+}
+
+void Visitor::BoundsCheckVisitor::assign(Symbol var, AST::BaseExpr* expr)
+{
+    Linear value = linear(expr);
+    Range range = rangeOf(value);
+    Symbol sizeOf = 0;
+    bool isSize = false;
+    if (value.kind == Linear::Size && value.offset == 0) {
+        isSize = true;
+        sizeOf = value.sym;
+    } else if (value.kind == Linear::Var && value.offset == 0) {
+        auto sizeVar = _state.sizeVars.find(value.sym);
+        if (sizeVar != _state.sizeVars.end()) {
+            isSize = true;
+            sizeOf = sizeVar->second;
+        }
+    }
+
+    _state.sizeVars.erase(var);
+    if (range == anyValue())
+        _state.ranges.erase(var);
+    else
+        _state.ranges[var] = std::move(range);
+    if (isSize)
+        _state.sizeVars[var] = sizeOf;
+}
+
+void Visitor::BoundsCheckVisitor::forgetArray(Symbol arr)
+{
+    for (auto it = _state.ranges.begin(); it != _state.ranges.end();) {
+        auto& below = it->second.below;
+        below.erase(std::remove_if(below.begin(), below.end(),
+                                   [arr](const std::pair<Symbol, int64_t>& fact) { return fact.first == arr; }),
+                    below.end());
+        if (it->second == anyValue())
+            it = _state.ranges.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = _state.sizeVars.begin(); it != _state.sizeVars.end();) {
+        if (it->second == arr)
+            it = _state.sizeVars.erase(it);
+        else
+            ++it;
+    }
+    _state.sizes.erase(arr);
+}
+
+void Visitor::BoundsCheckVisitor::markAssigned(Symbol name)
+{
+    for (auto& loop : _loops)
+        loop.assigned.insert(name);
+}
+
+bool Visitor::BoundsCheckVisitor::isInBounds(Symbol arr, AST::BaseExpr* idx) const
+{
+    if (!_state.reachable)
+        return false;
+
+    Range range = rangeOf(linear(idx));
+    if (range.lower < 0)
+        return false;
+    for (auto& fact : range.below) {
+        if (fact.first == arr && fact.second >= 0)
+            return true;
+    }
+    auto size = _state.sizes.find(arr);
+    return size != _state.sizes.end() && range.upper < size->second;
+}
+
+bool Visitor::BoundsCheckVisitor::isInvariant(AST::BaseExpr* expr, const std::unordered_set<Symbol>& assigned) const
+{
+    // only what can be evaluated in front of the loop without side effects or traps
+    if (dynamic_cast<AST::NumExpr*>(expr)) {
+        return true;
+    } else if (auto idExpr = dynamic_cast<AST::IdExpr*>(expr)) {
+        return idExpr->result.isIntValue() && !assigned.count(idExpr->name);
+    } else if (auto sizeofExpr = dynamic_cast<AST::SizeofExpr*>(expr)) {
+        auto arrId = dynamic_cast<AST::IdExpr*>(sizeofExpr->idExpr);
+        return arrId && !assigned.count(arrId->name);
+    } else if (auto binopExpr = dynamic_cast<AST::BinopExpr*>(expr)) {
+        if (binopExpr->op != Token::Op_add && binopExpr->op != Token::Op_minus &&
+            binopExpr->op != Token::Op_mult)
+            return false;
+        return isInvariant(binopExpr->leftExpr, assigned) && isInvariant(binopExpr->rightExpr, assigned);
+    } else if (auto unaryExpr = dynamic_cast<AST::UnaryExpr*>(expr)) {
+        return unaryExpr->type == Token::Op_minus && isInvariant(unaryExpr->expr, assigned);
+    }
+    return false;
+}
+
+AST::BoundsCheck Visitor::BoundsCheckVisitor::classify(AST::BaseStmt* access, Symbol arr, AST::BaseExpr* idx)
+{
+    Decision decision{AST::BoundsCheck::Full, nullptr, _numDecided++};
+    if (isInBounds(arr, idx)) {
+        decision.check = AST::BoundsCheck::None;
+    } else {
+        // in front of the outermost loop it can go
+        for (auto& loop : _loops) {
+            if (!loop.assigned.count(arr) && isInvariant(idx, loop.assigned)) {
+                decision.check = AST::BoundsCheck::Hoisted;
+                decision.loop = loop.hoistedChecks;
+                break;
+            }
+        }
+    }
+    _decisions[access] = decision;
+    return decision.check;
+}
+
+template <typename Body>
+void Visitor::BoundsCheckVisitor::analyzeLoop(ArenaArray<AST::BaseStmt*>* hoistedChecks, Body body)
+{
+    // passes after which the facts that keep changing are dropped
+    constexpr unsigned WideningPasses = 3;
+
+    _loops.push_back(Loop{hoistedChecks, {}});
+    State entry = _state;
+    State head = entry;
+    // the first pass finds out what the loop assigns, so there are at least two;
+    // the last one starts from the fixpoint and makes the decisions that stick
+    for (unsigned pass = 0; ; pass++) {
+        _state = head;
+        body();
+        State next = entry;
+        join(next, _state);
+        if (pass >= WideningPasses)
+            widen(next, head);
+        if (pass > 0 && next == head)
+            break;
+        head = std::move(next);
+    }
+    _loops.pop_back();
+    _state = std::move(head);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::StmtBlockStmt *stmtBlock)
+{
+    for (auto& stmt : stmtBlock->stmt_list)
+        stmt->accept(this);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::VarDeclStmt *stmt)
+{
+    for (auto& var : stmt->decls) {
+        markAssigned(var.name);
+        if (var.type == Token::Type_int) {
+            _state.sizeVars.erase(var.name);
+            _state.ranges[var.name] = Range{0, 0, {}};
+        } else if (var.type == Token::Type_array) {
+            forgetArray(var.name);
+        }
+    }
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::ArrayDeclStmt *stmt)
+{
+    for (auto& var : stmt->decls) {
+        var.expr->accept(this);
+        markAssigned(var.name);
+        forgetArray(var.name);
+        Linear size = linear(var.expr);
+        if (size.kind == Linear::Const) {
+            _state.sizes[var.name] = size.offset;
+        } else if (size.kind == Linear::Var) {
+            // var + o is the size, so var < size - o + 1
+            int64_t dist;
+            if (!__builtin_sub_overflow(size.offset, int64_t(1), &dist))
+                narrow(size.sym, Range{clampedSub(0, size.offset, _min, _max), _max, {{var.name, dist}}});
+            if (size.offset == 0)
+                _state.sizeVars[size.sym] = var.name;
+        }
+    }
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::PrintStmt *stmt)
+{
+    for (auto& arg : stmt->args)
+        arg->accept(this);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::IfStmt *stmt)
+{
+    stmt->cond->accept(this);
+    State before = _state;
+    assume(stmt->cond, true);
+    stmt->trueStmt->accept(this);
+    State afterTrue = std::move(_state);
+
+    _state = std::move(before);
+    assume(stmt->cond, false);
+    if (stmt->falseStmt)
+        stmt->falseStmt->accept(this);
+    join(_state, afterTrue);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::WhileStmt *stmt)
+{
+    analyzeLoop(&stmt->hoistedChecks, [this, stmt]() {
+        stmt->cond->accept(this);
+        assume(stmt->cond, true);
+        stmt->body->accept(this);
+    });
+    assume(stmt->cond, false);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::ForStmt *stmt)
+{
+    AST::IdExpr* idExpr = dynamic_cast<AST::IdExpr*>(stmt->ident);
+    if (!idExpr)
+        throw Exception("For stmt doesn't contain any valid id expr.");
+
+    analyzeLoop(&stmt->hoistedChecks, [this, stmt, idExpr]() {
+        // takes the value of every element in turn
+        markAssigned(idExpr->name);
+        _state.ranges.erase(idExpr->name);
+        _state.sizeVars.erase(idExpr->name);
+        stmt->body->accept(this);
+    });
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::ReturnStmt *stmt)
+{
+    if (stmt->returnExpr)
+        stmt->returnExpr->accept(this);
+    _state.reachable = false;
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::AbortStmt *stmt)
+{
+    // its arguments are never evaluated
+    _state.reachable = false;
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::ArrayAssignment *stmt)
+{
+    stmt->idxExpr->accept(this);
+    stmt->boundsCheck = classify(stmt, stmt->name, stmt->idxExpr);
+    stmt->expr->accept(this);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::VarAssignment *stmt)
+{
+    stmt->expr->accept(this);
+    markAssigned(stmt->name);
+    if (stmt->expr->result.isArrayValue())
+        forgetArray(stmt->name);
+    else if (stmt->expr->result.isIntValue())
+        assign(stmt->name, stmt->expr);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::BaseExpr* expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::TrueExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::FalseExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::NumExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::IdExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::LiteralExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::StringLiteralExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::TernaryExpr* expr)
+{
+    // only the arm the condition picks is evaluated, as in
+    // ((i < sizeof(arr)) ? arr[i] : 0)
+    expr->condExpr->accept(this);
+    State before = _state;
+    assume(expr->condExpr, true);
+    expr->trueExpr->accept(this);
+    _state = before;
+    assume(expr->condExpr, false);
+    expr->falseExpr->accept(this);
+    _state = std::move(before);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::BinopExpr* expr)
+{
+    expr->leftExpr->accept(this);
+    // with --short-circuit the right side of & and | only runs when the left
+    // one is true and false respectively, as in ((i < n) & (arr[i] > 0))
+    if ((expr->op == Token::Op_and || expr->op == Token::Op_or) && Lilang::Settings::get().isOn("short-circuit")) {
+        State before = _state;
+        assume(expr->leftExpr, expr->op == Token::Op_and);
+        expr->rightExpr->accept(this);
+        _state = std::move(before);
+        return;
+    }
+    expr->rightExpr->accept(this);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::UnaryExpr *expr)
+{
+    expr->expr->accept(this);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::SizeofExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::InputExpr *expr)
+{
+
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::ArrayExpr *expr)
+{
+    expr->expr->accept(this);
+    expr->boundsCheck = classify(expr, expr->name, expr->expr);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::FnCallExpr *expr)
+{
+    for (auto& arg : expr->fnArgs)
+        arg->accept(this);
+}
+
+void Visitor::BoundsCheckVisitor::visit(AST::Program* program)
+{
+    size_t width = Lilang::Settings::get().getWidth();
+    _max = width >= 64 ? INT64_MAX : static_cast<int64_t>((uint64_t(1) << (width - 1)) - 1);
+    _min = -_max - 1;
+
+    for (auto& fnDef : program->fnDefinitions) {
+        // parameters can be anything
+        _state = State();
+        fnDef->body->accept(this);
+    }
+
+    std::unordered_map<ArenaArray<AST::BaseStmt*>*, std::vector<std::pair<unsigned, AST::BaseStmt*>>> hoisted;
+    for (auto& decision : _decisions) {
+        _numAccesses++;
+        if (decision.second.check == AST::BoundsCheck::None) {
+            _numRemoved++;
+        } else if (decision.second.check == AST::BoundsCheck::Hoisted) {
+            _numHoisted++;
+            hoisted[decision.second.loop].push_back({decision.second.order, decision.first});
+        }
+    }
+    for (auto& loop : hoisted) {
+        std::sort(loop.second.begin(), loop.second.end());
+        std::vector<AST::BaseStmt*> accesses;
+        for (auto& access : loop.second)
+            accesses.push_back(access.second);
+        *loop.first = program->arena.copy(accesses);
+    }
+}
+
+void Visitor::BoundsCheckVisitor::printStats(std::ostream& out) const
+{
+    out << "Bounds checks of " << _numAccesses << " array accesses:" << std::endl;
+    out << "\tremoved\t" << _numRemoved << std::endl;
+    out << "\thoisted\t" << _numHoisted << std::endl;
+}
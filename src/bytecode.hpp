@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace AST {
+    class FunctionDefinition;
+}
+
+// Register based bytecode run by the interpreter. Every function has a fixed
+// number of int64 registers: its parameters first, then its variables and the
+// temporaries of its expressions. Bools are 0 or 1 and arrays are pointers to
+// an Array.
+namespace Bytecode {
+    enum class Op : uint8_t {
+        // a := b, a := immediate b, a := the empty array
+        Move, LoadInt, EmptyArray,
+        // a := b op c
+        Add, Sub, Mul, Div, Mod, Pow, And, Or,
+        Eq, Ne, Lt, Le, Gt, Ge,
+        // a := b + immediate c
+        AddImm,
+        // a := op b
+        Not, Neg,
+        // jump to a, jump to b if a is false, count a loop back-edge and jump to a
+        Jump, JumpIfFalse, Loop,
+        // jump to c if a op b; the conditions of ifs and loops compile to these
+        JumpEq, JumpNe, JumpLt, JumpLe, JumpGt, JumpGe,
+        // a := function b called with the arguments in registers c, c+1, ...
+        Call,
+        Ret, RetVoid,
+        // print register a, print string a, a := input()
+        PrintInt, PrintString, Input, Abort,
+        // a := zeroed array of b elements, a := b[c], a[b] := c, a := sizeof(b)
+        NewArray, Load, Store, Size,
+        // a := top of the array stack, top of the array stack := a
+        StackSave, StackRestore,
+
+        // number of ops, not an op
+        NumOps
+    };
+
+    struct Instr {
+        Op op;
+        int32_t a;
+        int32_t b;
+        int32_t c;
+    };
+
+    // An instruction as the interpreter runs it when it's built with computed
+    // goto: the op is replaced with the address of the code handling it.
+    struct ThreadedInstr {
+        const void* handler;
+        int32_t a;
+        int32_t b;
+        int32_t c;
+    };
+
+    // same layout as the struct codegen uses for arrays at -width=64
+    struct Array {
+        int64_t size;
+        int64_t* data;
+    };
+
+    // entry point of a JIT compiled function, taking its arguments as registers
+    typedef int64_t (*NativeEntry)(const int64_t* args);
+
+    struct Function {
+        AST::FunctionDefinition* def = nullptr;
+        unsigned numParams = 0;
+        unsigned numRegs = 0;
+        std::vector<Instr> code;
+        // `code' threaded, on the first call
+        std::vector<ThreadedInstr> threaded;
+        // functions called from this one
+        std::vector<unsigned> callees;
+
+        // calls plus loop back-edges taken, for tiering up
+        uint32_t hotness = 0;
+        // whether the JIT may compile it; cleared if that failed
+        bool canCompile = true;
+        // whether the JIT has its code, which doesn't mean it can be called from
+        // the interpreter: see `native'
+        bool compiled = false;
+        NativeEntry native = nullptr;
+    };
+
+    struct Module {
+        std::vector<Function> functions;
+        // printed by PrintString
+        std::vector<const char*> strings;
+        unsigned mainIdx = 0;
+    };
+}
@@ -0,0 +1,477 @@
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+#include "utils.hpp"
+#include "baseast.hpp"
+#include "visitor.hpp"
+
+using Bytecode::Op;
+
+// ops that only write their `a' register, and so can write a variable directly
+static bool writesOnlyA(Op op)
+{
+    switch (op) {
+        case Op::LoadInt:
+        case Op::Add: case Op::Sub: case Op::Mul: case Op::Div: case Op::Mod: case Op::Pow:
+        case Op::And: case Op::Or:
+        case Op::Eq: case Op::Ne: case Op::Lt: case Op::Le: case Op::Gt: case Op::Ge:
+        case Op::AddImm: case Op::Not: case Op::Neg:
+        case Op::Input: case Op::Load: case Op::Size:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Op binopToOp(Token op)
+{
+    switch (op) {
+        case Token::Op_and:     return Op::And;
+        case Token::Op_or:      return Op::Or;
+        case Token::Op_neq:     return Op::Ne;
+        case Token::Op_eqeq:    return Op::Eq;
+        case Token::Op_gt:      return Op::Gt;
+        case Token::Op_gte:     return Op::Ge;
+        case Token::Op_lt:      return Op::Lt;
+        case Token::Op_lte:     return Op::Le;
+        case Token::Op_add:     return Op::Add;
+        case Token::Op_minus:   return Op::Sub;
+        case Token::Op_mult:    return Op::Mul;
+        case Token::Op_divide:  return Op::Div;
+        case Token::Op_mod:     return Op::Mod;
+        case Token::Op_exp:     return Op::Pow;
+        default:
+            throw Exception("bytecode: binop not handled");
+    }
+}
+
+// jump taken when the comparison `op' is false
+static bool inverseCompareJump(Token op, Op& jump)
+{
+    switch (op) {
+        case Token::Op_eqeq:    jump = Op::JumpNe; return true;
+        case Token::Op_neq:     jump = Op::JumpEq; return true;
+        case Token::Op_lt:      jump = Op::JumpGe; return true;
+        case Token::Op_lte:     jump = Op::JumpGt; return true;
+        case Token::Op_gt:      jump = Op::JumpLe; return true;
+        case Token::Op_gte:     jump = Op::JumpLt; return true;
+        default:
+            return false;
+    }
+}
+
+unsigned Visitor::BytecodeVisitor::newReg()
+{
+    unsigned reg = _nextReg++;
+    _fn->numRegs = std::max(_fn->numRegs, _nextReg);
+    return reg;
+}
+
+unsigned Visitor::BytecodeVisitor::emitExpr(AST::BaseExpr* expr)
+{
+    expr->accept(this);
+    return _resultReg;
+}
+
+void Visitor::BytecodeVisitor::emitExprInto(AST::BaseExpr* expr, unsigned dst)
+{
+    unsigned mark = _nextReg;
+    unsigned reg = emitExpr(expr);
+    if (reg == dst)
+        return;
+
+    // a temporary computed by the last instruction alone isn't needed
+    if (reg >= mark) {
+        Bytecode::Instr& last = _fn->code.back();
+        if (last.a == static_cast<int32_t>(reg) && writesOnlyA(last.op)) {
+            last.a = dst;
+            return;
+        }
+    }
+    emit(Op::Move, dst, reg);
+}
+
+size_t Visitor::BytecodeVisitor::emit(Op op, int32_t a, int32_t b, int32_t c)
+{
+    _fn->code.push_back({op, a, b, c});
+    return _fn->code.size() - 1;
+}
+
+size_t Visitor::BytecodeVisitor::emitJumpIfFalse(AST::BaseExpr* cond)
+{
+    // comparisons branch directly instead of going through a bool
+    AST::BinopExpr* binop = dynamic_cast<AST::BinopExpr*>(cond);
+    Op jump;
+    if (binop && inverseCompareJump(binop->op, jump)) {
+        unsigned lhs = emitExpr(binop->leftExpr);
+        unsigned rhs = emitExpr(binop->rightExpr);
+        return emit(jump, lhs, rhs);
+    }
+    return emit(Op::JumpIfFalse, emitExpr(cond));
+}
+
+void Visitor::BytecodeVisitor::patchTarget(size_t at, size_t target)
+{
+    Bytecode::Instr& instr = _fn->code[at];
+    switch (instr.op) {
+        case Op::JumpIfFalse:
+            instr.b = target;
+            break;
+        case Op::JumpEq: case Op::JumpNe: case Op::JumpLt:
+        case Op::JumpLe: case Op::JumpGt: case Op::JumpGe:
+            instr.c = target;
+            break;
+        default:
+            instr.a = target;
+    }
+}
+
+void Visitor::BytecodeVisitor::visit(AST::StmtBlockStmt *stmtBlock)
+{
+    unsigned blockStart = _nextReg;
+
+    // arrays declared in the block are released when leaving it
+    int stackReg = -1;
+    for (auto& stmt : stmtBlock->stmt_list) {
+        if (dynamic_cast<AST::ArrayDeclStmt*>(stmt)) {
+            stackReg = newReg();
+            emit(Op::StackSave, stackReg);
+            break;
+        }
+    }
+
+    bool returned = false;
+    for (auto& stmt : stmtBlock->stmt_list)
+    {
+        unsigned mark = _nextReg;
+        stmt->accept(this);
+        if (dynamic_cast<AST::ReturnStmt*>(stmt)) {
+            returned = true;
+            break; // no need to process other stmts now
+        }
+        // only declarations keep the registers they took
+        if (!dynamic_cast<AST::VarDeclStmt*>(stmt) && !dynamic_cast<AST::ArrayDeclStmt*>(stmt))
+            _nextReg = mark;
+    }
+
+    if (stackReg >= 0 && !returned)
+        emit(Op::StackRestore, stackReg);
+    _nextReg = blockStart;
+}
+
+void Visitor::BytecodeVisitor::visit(AST::VarDeclStmt *stmt)
+{
+    for (auto& var : stmt->decls)
+    {
+        unsigned reg = newReg();
+        if (var.type == Token::Type_array)
+            emit(Op::EmptyArray, reg);
+        else
+            emit(Op::LoadInt, reg, 0);
+        _vars[var.name] = reg;
+    }
+}
+
+void Visitor::BytecodeVisitor::visit(AST::ArrayDeclStmt *stmt)
+{
+    for (auto& var : stmt->decls)
+    {
+        unsigned reg = newReg();
+        unsigned mark = _nextReg;
+        emit(Op::NewArray, reg, emitExpr(var.expr));
+        _nextReg = mark;
+        _vars[var.name] = reg;
+    }
+}
+
+void Visitor::BytecodeVisitor::visit(AST::PrintStmt *stmt)
+{
+    for (auto& arg : stmt->args) {
+        if (auto strExpr = dynamic_cast<AST::StringLiteralExpr*>(arg)) {
+            auto it = _strings.find(strExpr->val);
+            if (it == _strings.end()) {
+                it = _strings.emplace(strExpr->val, _module.strings.size()).first;
+                _module.strings.push_back(Interner::get().name(strExpr->val).c_str());
+            }
+            emit(Op::PrintString, it->second);
+        } else {
+            emit(Op::PrintInt, emitExpr(arg));
+        }
+    }
+}
+
+void Visitor::BytecodeVisitor::visit(AST::IfStmt *stmt)
+{
+    unsigned mark = _nextReg;
+    size_t skipTrue = emitJumpIfFalse(stmt->cond);
+    _nextReg = mark;
+
+    stmt->trueStmt->accept(this);
+    if (stmt->falseStmt) {
+        size_t skipFalse = emit(Op::Jump);
+        patchTarget(skipTrue, here());
+        stmt->falseStmt->accept(this);
+        patchTarget(skipFalse, here());
+    } else {
+        patchTarget(skipTrue, here());
+    }
+}
+
+void Visitor::BytecodeVisitor::visit(AST::WhileStmt *stmt)
+{
+    size_t loopHdr = here();
+    unsigned mark = _nextReg;
+    size_t exitLoop = emitJumpIfFalse(stmt->cond);
+    _nextReg = mark;
+
+    stmt->body->accept(this);
+    emit(Op::Loop, loopHdr);
+    patchTarget(exitLoop, here());
+}
+
+void Visitor::BytecodeVisitor::visit(AST::ForStmt *stmt)
+{
+    AST::IdExpr* idExpr = dynamic_cast<AST::IdExpr*>(stmt->ident);
+    AST::IdExpr* contExpr = dynamic_cast<AST::IdExpr*>(stmt->container);
+    if (!idExpr || !contExpr)
+        throw Exception("For stmt doesn't contain any valid id or container expr.");
+
+    // like the native loop, goes over the array the variable held when it started
+    unsigned array = newReg();
+    unsigned size = newReg();
+    unsigned counter = newReg();
+    unsigned elem = newReg();
+    emit(Op::Move, array, _vars.at(contExpr->name));
+    emit(Op::Size, size, array);
+    emit(Op::LoadInt, counter, 0);
+    _vars[idExpr->name] = elem;
+
+    size_t loopHdr = here();
+    size_t exitLoop = emit(Op::JumpGe, counter, size);
+    emit(Op::Load, elem, array, counter);
+    stmt->body->accept(this);
+    emit(Op::AddImm, counter, counter, 1);
+    emit(Op::Loop, loopHdr);
+    patchTarget(exitLoop, here());
+}
+
+void Visitor::BytecodeVisitor::visit(AST::ReturnStmt *stmt)
+{
+    auto call = dynamic_cast<AST::FnCallExpr*>(stmt->returnExpr);
+    if (call && call->tailCall == AST::TailCall::Self) {
+        // the parameters are the first registers and the code starts with the
+        // body; variables are zeroed where they're declared
+        unsigned base = _nextReg;
+        for (size_t i = 0; i < call->fnArgs.size(); i++)
+            newReg();
+        for (size_t i = 0; i < call->fnArgs.size(); i++)
+            emitExprInto(call->fnArgs[i], base + i);
+        for (size_t i = 0; i < call->fnArgs.size(); i++)
+            emit(Op::Move, i, base + i);
+        emit(Op::Loop, 0);
+        return;
+    }
+
+    if (stmt->returnExpr)
+        emit(Op::Ret, emitExpr(stmt->returnExpr));
+    else
+        emit(Op::RetVoid);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::AbortStmt *stmt)
+{
+    emit(Op::Abort);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::ArrayAssignment *stmt)
+{
+    unsigned idx = emitExpr(stmt->idxExpr);
+    unsigned val = emitExpr(stmt->expr);
+    emit(Op::Store, _vars.at(stmt->name), idx, val);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::VarAssignment *stmt)
+{
+    emitExprInto(stmt->expr, _vars.at(stmt->name));
+}
+
+void Visitor::BytecodeVisitor::visit(AST::BaseExpr* expr)
+{
+
+}
+
+void Visitor::BytecodeVisitor::visit(AST::TrueExpr *expr)
+{
+    _resultReg = newReg();
+    emit(Op::LoadInt, _resultReg, 1);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::FalseExpr *expr)
+{
+    _resultReg = newReg();
+    emit(Op::LoadInt, _resultReg, 0);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::NumExpr *expr)
+{
+    _resultReg = newReg();
+    emit(Op::LoadInt, _resultReg, expr->val);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::IdExpr *expr)
+{
+    auto it = _vars.find(expr->name);
+    if (it == _vars.end())
+        throw Exception("No such variable found");
+    _resultReg = it->second;
+}
+
+void Visitor::BytecodeVisitor::visit(AST::LiteralExpr *expr)
+{
+    throw Exception("bytecode: unexpected literal expression");
+}
+
+void Visitor::BytecodeVisitor::visit(AST::StringLiteralExpr *expr)
+{
+    throw Exception("bytecode: string literals can only be printed");
+}
+
+void Visitor::BytecodeVisitor::visit(AST::TernaryExpr* expr)
+{
+    // only the arm chosen is evaluated, like codegen does for arms that aren't
+    // cheap; for the rest it makes no difference
+    unsigned res = newReg();
+    size_t skipTrue = emitJumpIfFalse(expr->condExpr);
+    emit(Op::Move, res, emitExpr(expr->trueExpr));
+    size_t skipFalse = emit(Op::Jump);
+    patchTarget(skipTrue, here());
+    emit(Op::Move, res, emitExpr(expr->falseExpr));
+    patchTarget(skipFalse, here());
+    _resultReg = res;
+}
+
+void Visitor::BytecodeVisitor::visit(AST::BinopExpr* expr)
+{
+    // adding or subtracting a number is common enough to not load it first;
+    // folding can leave INT_MIN, which can't be negated into the immediate
+    AST::NumExpr* num = dynamic_cast<AST::NumExpr*>(expr->rightExpr);
+    if (num && (expr->op == Token::Op_add || (expr->op == Token::Op_minus && num->val != INT_MIN))) {
+        unsigned lhs = emitExpr(expr->leftExpr);
+        _resultReg = newReg();
+        emit(Op::AddImm, _resultReg, lhs, expr->op == Token::Op_add ? num->val : -num->val);
+        return;
+    }
+
+    // with --short-circuit, the right side of & and | is skipped once the left
+    // one decides the result
+    if ((expr->op == Token::Op_and || expr->op == Token::Op_or) && Lilang::Settings::get().isOn("short-circuit")) {
+        unsigned res = newReg();
+        emit(Op::Move, res, emitExpr(expr->leftExpr));
+        size_t skipRhs;
+        if (expr->op == Token::Op_and) {
+            skipRhs = emit(Op::JumpIfFalse, res);
+        } else {
+            unsigned falseReg = newReg();
+            emit(Op::LoadInt, falseReg, 0);
+            skipRhs = emit(Op::JumpNe, res, falseReg);
+        }
+        emit(Op::Move, res, emitExpr(expr->rightExpr));
+        patchTarget(skipRhs, here());
+        _resultReg = res;
+        return;
+    }
+
+    unsigned lhs = emitExpr(expr->leftExpr);
+    unsigned rhs = emitExpr(expr->rightExpr);
+    _resultReg = newReg();
+    emit(binopToOp(expr->op), _resultReg, lhs, rhs);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::UnaryExpr *expr)
+{
+    unsigned operand = emitExpr(expr->expr);
+    _resultReg = newReg();
+    switch(expr->type) {
+        case Token::Op_bang:
+            emit(Op::Not, _resultReg, operand);
+        break;
+        case Token::Op_minus:
+            emit(Op::Neg, _resultReg, operand);
+        break;
+        default:
+            throw Exception("bytecode: unindentified unary op");
+    }
+}
+
+void Visitor::BytecodeVisitor::visit(AST::SizeofExpr *expr)
+{
+    unsigned array = emitExpr(expr->idExpr);
+    _resultReg = newReg();
+    emit(Op::Size, _resultReg, array);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::InputExpr *expr)
+{
+    _resultReg = newReg();
+    emit(Op::Input, _resultReg);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::ArrayExpr *expr)
+{
+    unsigned idx = emitExpr(expr->expr);
+    _resultReg = newReg();
+    emit(Op::Load, _resultReg, _vars.at(expr->name), idx);
+}
+
+void Visitor::BytecodeVisitor::visit(AST::FnCallExpr *expr)
+{
+    auto it = _fnIndices.find(expr->name);
+    if (it == _fnIndices.end())
+        throw Exception("Cannot find func : " + Interner::get().name(expr->name));
+    unsigned callee = it->second;
+
+    // the arguments go to consecutive registers, the first of which gets the result
+    unsigned base = _nextReg;
+    for (size_t i = 0; i < std::max<size_t>(expr->fnArgs.size(), 1); i++)
+        newReg();
+    for (size_t i = 0; i < expr->fnArgs.size(); i++)
+        emitExprInto(expr->fnArgs[i], base + i);
+
+    emit(Op::Call, base, callee, base);
+    if (std::find(_fn->callees.begin(), _fn->callees.end(), callee) == _fn->callees.end())
+        _fn->callees.push_back(callee);
+    _resultReg = base;
+}
+
+void Visitor::BytecodeVisitor::visit(AST::Program* program)
+{
+    _module.functions.resize(program->fnDefinitions.size());
+    for (size_t i = 0; i < program->fnDefinitions.size(); i++)
+    {
+        AST::FunctionDefinition* fnDef = program->fnDefinitions[i];
+        Bytecode::Function& fn = _module.functions[i];
+        fn.def = fnDef;
+        fn.numParams = fnDef->proto->fnParams.size();
+        // the native entry point returns a single register, which can't hold an array
+        fn.canCompile = fnDef->proto->fnType != Token::Type_array;
+        _fnIndices[fnDef->proto->fnName] = i;
+    }
+    _module.mainIdx = _fnIndices.at(Interner::get().intern("main"));
+
+    for (size_t i = 0; i < program->fnDefinitions.size(); i++)
+    {
+        AST::FunctionDefinition* fnDef = program->fnDefinitions[i];
+        _fn = &_module.functions[i];
+        _vars.clear();
+        _nextReg = 0;
+        for (auto& param : fnDef->proto->fnParams)
+            _vars[param.name] = newReg();
+
+        fnDef->body->accept(this);
+
+        // void functions may just end
+        if (_fn->code.empty() || (_fn->code.back().op != Op::Ret && _fn->code.back().op != Op::RetVoid))
+            emit(Op::RetVoid);
+    }
+}
@@ -0,0 +1,204 @@
+#include <algorithm>
+
+#include "utils.hpp"
+#include "baseast.hpp"
+#include "visitor.hpp"
+
+namespace {
+    // how many times bigger than what's inlined a function can be to still be
+    // specialized; the copies are cut down by the constants they get
+    const unsigned specializeFactor = 4;
+}
+
+unsigned Visitor::CallGraphVisitor::inlineLimit()
+{
+    std::string limit = Lilang::Settings::get().getOptionValue("inline-limit");
+    return limit.empty() ? 60 : std::stoul(limit);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::StmtBlockStmt *stmtBlock)
+{
+    for (auto& stmt : stmtBlock->stmt_list)
+    {
+        _node->size++;
+        stmt->accept(this);
+    }
+}
+
+void Visitor::CallGraphVisitor::visit(AST::VarDeclStmt *stmt)
+{
+
+}
+
+void Visitor::CallGraphVisitor::visit(AST::ArrayDeclStmt *stmt)
+{
+    for (auto& var : stmt->decls)
+        var.expr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::PrintStmt *stmt)
+{
+    for (auto& arg : stmt->args)
+        arg->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::IfStmt *stmt)
+{
+    stmt->cond->accept(this);
+    stmt->trueStmt->accept(this);
+    if (stmt->falseStmt)
+        stmt->falseStmt->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::WhileStmt *stmt)
+{
+    stmt->cond->accept(this);
+    stmt->body->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::ForStmt *stmt)
+{
+    stmt->body->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::ReturnStmt *stmt)
+{
+    if (stmt->returnExpr)
+        stmt->returnExpr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::AbortStmt *stmt)
+{
+
+}
+
+void Visitor::CallGraphVisitor::visit(AST::ArrayAssignment *stmt)
+{
+    stmt->idxExpr->accept(this);
+    stmt->expr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::VarAssignment *stmt)
+{
+    stmt->expr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::BaseExpr* expr)
+{
+
+}
+
+void Visitor::CallGraphVisitor::visit(AST::TrueExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::FalseExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::NumExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::IdExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::LiteralExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::StringLiteralExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::TernaryExpr* expr)
+{
+    _node->size++;
+    expr->condExpr->accept(this);
+    expr->trueExpr->accept(this);
+    expr->falseExpr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::BinopExpr* expr)
+{
+    _node->size++;
+    expr->leftExpr->accept(this);
+    expr->rightExpr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::UnaryExpr *expr)
+{
+    _node->size++;
+    expr->expr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::SizeofExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::InputExpr *expr)
+{
+    _node->size++;
+}
+
+void Visitor::CallGraphVisitor::visit(AST::ArrayExpr *expr)
+{
+    _node->size++;
+    expr->expr->accept(this);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::FnCallExpr *expr)
+{
+    _node->size++;
+    for (auto& arg : expr->fnArgs)
+        arg->accept(this);
+
+    auto it = _fnDefs.find(expr->name);
+    if (it == _fnDefs.end())
+        throw Exception("Cannot find func : " + Interner::get().name(expr->name));
+    auto& callees = _node->callees;
+    if (std::find(callees.begin(), callees.end(), it->second) == callees.end())
+        callees.push_back(it->second);
+}
+
+void Visitor::CallGraphVisitor::visit(AST::Program* program)
+{
+    for (auto& fnDef : program->fnDefinitions)
+        _fnDefs[fnDef->proto->fnName] = fnDef;
+
+    for (auto& fnDef : program->fnDefinitions) {
+        _node = &_nodes[fnDef];
+        fnDef->body->accept(this);
+    }
+
+    // main is called from outside, and only once
+    Symbol mainName = Interner::get().intern("main");
+    unsigned limit = inlineLimit();
+    for (auto& fnDef : program->fnDefinitions) {
+        const Node& node = _nodes[fnDef];
+        if (fnDef->proto->fnName == mainName || limit == 0)
+            continue;
+        if (node.callees.empty() && node.size <= limit) {
+            fnDef->alwaysInline = true;
+            _numInlined++;
+        } else if (node.size <= limit * specializeFactor) {
+            fnDef->specialize = true;
+            _numSpecialized++;
+        }
+    }
+}
+
+void Visitor::CallGraphVisitor::printStats(std::ostream& out) const
+{
+    out << "Functions of the call graph:" << std::endl;
+    out << "\tinlined\t" << _numInlined << std::endl;
+    out << "\tspecializable\t" << _numSpecialized << std::endl;
+}
@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <map>
 
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 
 #include "utils.hpp"
 #include "baseast.hpp"
@@ -10,18 +14,104 @@
 #include "symtab.hpp"
 
 namespace IntrinsicFn {
-    constexpr auto printstring = "__l_print_string";
-    constexpr auto printint = "__l_print_int";
+    constexpr auto print = "__l_print";
     constexpr auto abort = "__l_abort";
-    constexpr auto pow = "__l_pow";
+    constexpr auto outOfBounds = "__l_out_of_bounds";
     constexpr auto input = "__l_input";
+    constexpr auto arenaAlloc = "__l_arena_alloc";
+    constexpr auto arenaMark = "__l_arena_mark";
+    constexpr auto arenaRelease = "__l_arena_release";
 };
 
+namespace {
+    // Whether evaluating `expr' can do more than compute a value: call a
+    // function, read input or fail a bounds check.
+    bool hasEffects(AST::BaseExpr* expr)
+    {
+        if (auto binopExpr = dynamic_cast<AST::BinopExpr*>(expr))
+            return hasEffects(binopExpr->leftExpr) || hasEffects(binopExpr->rightExpr);
+        if (auto unaryExpr = dynamic_cast<AST::UnaryExpr*>(expr))
+            return hasEffects(unaryExpr->expr);
+        if (auto ternaryExpr = dynamic_cast<AST::TernaryExpr*>(expr))
+            return hasEffects(ternaryExpr->condExpr) || hasEffects(ternaryExpr->trueExpr) ||
+                   hasEffects(ternaryExpr->falseExpr);
+        if (auto arrayExpr = dynamic_cast<AST::ArrayExpr*>(expr))
+            return arrayExpr->boundsCheck != AST::BoundsCheck::None || hasEffects(arrayExpr->expr);
+        return dynamic_cast<AST::FnCallExpr*>(expr) || dynamic_cast<AST::InputExpr*>(expr);
+    }
+
+    // Whether `expr' is cheap enough to evaluate even when its value isn't
+    // needed, and can't fail or do anything else while at it.
+    bool isCheap(AST::BaseExpr* expr)
+    {
+        if (auto binopExpr = dynamic_cast<AST::BinopExpr*>(expr))
+            return binopExpr->op != Token::Op_exp && binopExpr->op != Token::Op_divide &&
+                   binopExpr->op != Token::Op_mod && isCheap(binopExpr->leftExpr) &&
+                   isCheap(binopExpr->rightExpr);
+        if (auto unaryExpr = dynamic_cast<AST::UnaryExpr*>(expr))
+            return isCheap(unaryExpr->expr);
+        if (auto ternaryExpr = dynamic_cast<AST::TernaryExpr*>(expr))
+            return isCheap(ternaryExpr->condExpr) && isCheap(ternaryExpr->trueExpr) &&
+                   isCheap(ternaryExpr->falseExpr);
+        return !dynamic_cast<AST::ArrayExpr*>(expr) && !dynamic_cast<AST::FnCallExpr*>(expr) &&
+               !dynamic_cast<AST::InputExpr*>(expr);
+    }
+
+    // Whether a loop body can be vectorized: no calls, no loops and no way out
+    // of the loop but its end. Loops that can't be are not asked to be, LLVM
+    // warns about every one it was asked to vectorize and couldn't.
+    bool isVectorizable(AST::BaseExpr* expr)
+    {
+        if (auto binopExpr = dynamic_cast<AST::BinopExpr*>(expr))
+            // a power is a loop of its own unless the exponent is constant, and a
+            // short-circuit branches around a right side that isn't cheap
+            return (binopExpr->op != Token::Op_exp || dynamic_cast<AST::NumExpr*>(binopExpr->rightExpr)) &&
+                   ((binopExpr->op != Token::Op_and && binopExpr->op != Token::Op_or) ||
+                    !Lilang::Settings::get().isOn("short-circuit") || isCheap(binopExpr->rightExpr)) &&
+                   binopExpr->op != Token::Op_divide &&
+                   binopExpr->op != Token::Op_mod && isVectorizable(binopExpr->leftExpr) &&
+                   isVectorizable(binopExpr->rightExpr);
+        if (auto unaryExpr = dynamic_cast<AST::UnaryExpr*>(expr))
+            return isVectorizable(unaryExpr->expr);
+        // arms that aren't cheap are branched over
+        if (auto ternaryExpr = dynamic_cast<AST::TernaryExpr*>(expr))
+            return isVectorizable(ternaryExpr->condExpr) && isCheap(ternaryExpr->trueExpr) &&
+                   isCheap(ternaryExpr->falseExpr);
+        if (auto arrayExpr = dynamic_cast<AST::ArrayExpr*>(expr))
+            return arrayExpr->boundsCheck == AST::BoundsCheck::None && isVectorizable(arrayExpr->expr);
+        return !dynamic_cast<AST::FnCallExpr*>(expr) && !dynamic_cast<AST::InputExpr*>(expr);
+    }
+
+    bool isVectorizable(AST::StmtBlockStmt* block)
+    {
+        for (auto stmt : block->stmt_list) {
+            if (auto varAssignment = dynamic_cast<AST::VarAssignment*>(stmt)) {
+                if (!isVectorizable(varAssignment->expr))
+                    return false;
+            } else if (auto arrayAssignment = dynamic_cast<AST::ArrayAssignment*>(stmt)) {
+                if (arrayAssignment->boundsCheck != AST::BoundsCheck::None ||
+                    !isVectorizable(arrayAssignment->idxExpr) || !isVectorizable(arrayAssignment->expr))
+                    return false;
+            } else if (auto ifStmt = dynamic_cast<AST::IfStmt*>(stmt)) {
+                if (!isVectorizable(ifStmt->cond) || !isVectorizable(ifStmt->trueStmt) ||
+                    (ifStmt->falseStmt && !isVectorizable(ifStmt->falseStmt)))
+                    return false;
+            } else if (auto innerBlock = dynamic_cast<AST::StmtBlockStmt*>(stmt)) {
+                if (!isVectorizable(innerBlock))
+                    return false;
+            } else if (!dynamic_cast<AST::VarDeclStmt*>(stmt)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
 // static variable init
 llvm::LLVMContext Visitor::CodegenVisitor::_TheContext;
 std::unique_ptr<llvm::Module> Visitor::CodegenVisitor::_TheModule = llvm::make_unique<llvm::Module>("lilang", Visitor::CodegenVisitor::_TheContext);
 llvm::IRBuilder<> Visitor::CodegenVisitor::_Builder(Visitor::CodegenVisitor::_TheContext);
-std::map<std::string, llvm::AllocaInst*> Visitor::CodegenVisitor::_NamedValues;
+std::unordered_map<Symbol, llvm::AllocaInst*> Visitor::CodegenVisitor::_NamedValues;
 
 llvm::Value* Visitor::CodegenVisitor::UpdateToIntWidth(llvm::Value* val, size_t toWidth) {
     if (!val->getType()->isIntegerTy())
@@ -83,74 +173,164 @@ llvm::AllocaInst* Visitor::CodegenVisitor::CreateEntryBlockAlloca(llvm::Function
     return allocaInst;
 }
 
+uint64_t Visitor::CodegenVisitor::stackArrayLimit()
+{
+    std::string limit = Lilang::Settings::get().getOptionValue("stack-array-limit");
+    return limit.empty() ? 64 * 1024 : std::stoull(limit);
+}
+
+bool Visitor::CodegenVisitor::fitsOnStack(llvm::Value* arrSize)
+{
+    auto constSize = llvm::dyn_cast<llvm::ConstantInt>(arrSize);
+    if (!constSize)
+        return false;
+    uint64_t elemSize = _TheModule->getDataLayout().getTypeAllocSize(CreateLLVMType(Token::Type_int));
+    // negative sizes are left to the arena to report
+    return constSize->getValue().ule(stackArrayLimit() / elemSize);
+}
+
 llvm::AllocaInst* Visitor::CodegenVisitor::CreateAllocaArray(llvm::Function* func,
                                                              const std::string& varName,
                                                              llvm::Value* arrSize)
 {
+    auto dataType = CreateLLVMType(Token::Type_int);
+    const llvm::DataLayout& dl = _TheModule->getDataLayout();
+    uint64_t elemSize = dl.getTypeAllocSize(dataType);
+    auto constSize = llvm::dyn_cast<llvm::ConstantInt>(arrSize);
+    bool onStack = fitsOnStack(arrSize);
+    // whether the size is only known at runtime, and so is where the array goes
+    bool eitherWay = !constSize;
+
+    llvm::BasicBlock* stackBB = nullptr;
+    llvm::BasicBlock* arenaBB = nullptr;
+    llvm::BasicBlock* mergeBB = nullptr;
+    if (eitherWay) {
+        stackBB = llvm::BasicBlock::Create(_TheContext, "stackarray", func);
+        arenaBB = llvm::BasicBlock::Create(_TheContext, "arenaarray", func);
+        mergeBB = llvm::BasicBlock::Create(_TheContext, "arraydata", func);
+        llvm::Value* small = _Builder.CreateICmpULE(arrSize, llvm::ConstantInt::get(dataType, stackArrayLimit() / elemSize));
+        _Builder.CreateCondBr(small, stackBB, arenaBB);
+    }
+
+    llvm::Value* stackData = nullptr;
+    if (onStack || eitherWay) {
+        if (eitherWay)
+            _Builder.SetInsertPoint(stackBB);
+        stackData = _Builder.CreateAlloca(dataType, arrSize, varName.c_str());
+
+        // memset 0 in the array; -O2 drops it when every element is stored
+        // to before being loaded
+        if (dataType->isSized()) {
+            uint64_t bitsSize = dl.getTypeSizeInBits(dataType);
+            auto len = _Builder.CreateMul(llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), (bitsSize / 8)), arrSize);
+            _Builder.CreateCall(_TheModule->getFunction("llvm.memset.p0i8.i64"), {_Builder.CreateBitCast(stackData, llvm::Type::getInt8PtrTy(_TheContext)),
+                                                                            llvm::ConstantInt::get(llvm::Type::getInt8Ty(_TheContext), 0),
+                                                                            len,
+                                                                            llvm::ConstantInt::getFalse(_TheContext)});    }
+        if (eitherWay)
+            _Builder.CreateBr(mergeBB);
+    }
+
+    // comes zeroed, page by page as it's touched
+    llvm::Value* arenaData = nullptr;
+    if (!onStack) {
+        if (eitherWay)
+            _Builder.SetInsertPoint(arenaBB);
+        llvm::Value* mem = _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::arenaAlloc),
+                                               {UpdateToIntWidth(arrSize, 64),
+                                                llvm::ConstantInt::get(llvm::Type::getInt64Ty(_TheContext), elemSize)});
+        arenaData = _Builder.CreateBitCast(mem, dataType->getPointerTo(), varName.c_str());
+        if (eitherWay)
+            _Builder.CreateBr(mergeBB);
+    }
+
+    llvm::Value* data = onStack ? stackData : arenaData;
+    if (eitherWay) {
+        _Builder.SetInsertPoint(mergeBB);
+        llvm::PHINode* phi = _Builder.CreatePHI(dataType->getPointerTo(), 2, varName.c_str());
+        phi->addIncoming(stackData, stackBB);
+        phi->addIncoming(arenaData, arenaBB);
+        data = phi;
+    }
 
-    llvm::Value* dataAlloca = _Builder.CreateAlloca(CreateLLVMType(Token::Type_int), arrSize, varName.c_str());
     llvm::AllocaInst* arrayAlloca = _Builder.CreateAlloca(CreateLLVMType(Token::Type_array));
     llvm::Value* sizePtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 0)});
     _Builder.CreateStore(arrSize, sizePtr);
-    auto dataType = CreateLLVMType(Token::Type_int);
     llvm::Value* dataPtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(dataType, 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 1)});
-
-    // memset 0 in the array
-    if (dataType->isSized()) {
-        const llvm::DataLayout& dl = _TheModule->getDataLayout();
-        uint64_t bitsSize = dl.getTypeSizeInBits(dataType);
-        auto len = _Builder.CreateMul(llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), (bitsSize / 8)), arrSize);
-        _Builder.CreateCall(_TheModule->getFunction("llvm.memset.p0i8.i64"), {_Builder.CreateBitCast(dataAlloca, llvm::Type::getInt8PtrTy(_TheContext)),
-                                                                        llvm::ConstantInt::get(llvm::Type::getInt8Ty(_TheContext), 0),
-                                                                        len,
-                                                                        llvm::ConstantInt::getFalse(_TheContext)});    }
-    _Builder.CreateStore(dataAlloca, dataPtr);
+    _Builder.CreateStore(data, dataPtr);
     return arrayAlloca;
 }
 
 void Visitor::CodegenVisitor::declareRuntimeFns()
 {
-    if (!(_TheModule->getFunction(IntrinsicFn::printstring)))
+    if (!(_TheModule->getFunction(IntrinsicFn::print)))
     {
         llvm::FunctionType *funcType = llvm::FunctionType::get(CreateLLVMType(Token::Type_void),
                                                                llvm::Type::getInt8PtrTy(_TheContext),
+                                                               true);
+        llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                IntrinsicFn::print, _TheModule.get());
+    }
+
+    if (!(_TheModule->getFunction(IntrinsicFn::input)))
+    {
+        llvm::FunctionType *funcType = llvm::FunctionType::get(llvm::Type::getInt64Ty(_TheContext),
                                                                false);
         llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                IntrinsicFn::printstring, _TheModule.get());
+                                      IntrinsicFn::input, _TheModule.get());
     }
 
-    if (!(_TheModule->getFunction(IntrinsicFn::printint)))
+    if (!(_TheModule->getFunction(IntrinsicFn::abort)))
     {
         llvm::FunctionType *funcType = llvm::FunctionType::get(CreateLLVMType(Token::Type_void),
-                                                               llvm::Type::getInt64Ty(_TheContext),
                                                                false);
         llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                IntrinsicFn::printint, _TheModule.get());
+                                      IntrinsicFn::abort, _TheModule.get());
     }
 
-    if (!(_TheModule->getFunction(IntrinsicFn::input)))
+    if (!(_TheModule->getFunction(IntrinsicFn::outOfBounds)))
     {
-        llvm::FunctionType *funcType = llvm::FunctionType::get(llvm::Type::getInt64Ty(_TheContext),
+        llvm::FunctionType *funcType = llvm::FunctionType::get(CreateLLVMType(Token::Type_void),
+                                                               {llvm::Type::getInt64Ty(_TheContext)},
                                                                false);
-        llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                      IntrinsicFn::input, _TheModule.get());
+        llvm::Function* func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                                      IntrinsicFn::outOfBounds, _TheModule.get());
+        // keeps the code calling it out of the way of the code that doesn't fail
+        func->addFnAttr(llvm::Attribute::Cold);
+        func->addFnAttr(llvm::Attribute::NoReturn);
+        func->addFnAttr(llvm::Attribute::NoUnwind);
     }
 
-    if (!(_TheModule->getFunction(IntrinsicFn::pow)))
+    // arrays too big for the stack, see CreateAllocaArray
+    if (!(_TheModule->getFunction(IntrinsicFn::arenaAlloc)))
     {
-        llvm::FunctionType *funcType = llvm::FunctionType::get(CreateLLVMType(Token::Type_int),
-                                                               {CreateLLVMType(Token::Type_int), CreateLLVMType(Token::Type_int)},
+        llvm::FunctionType *funcType = llvm::FunctionType::get(llvm::Type::getInt8PtrTy(_TheContext),
+                                                               {llvm::Type::getInt64Ty(_TheContext),
+                                                                llvm::Type::getInt64Ty(_TheContext)},
                                                                false);
-        llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                      IntrinsicFn::pow, _TheModule.get());
+        llvm::Function* func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                                      IntrinsicFn::arenaAlloc, _TheModule.get());
+        func->addFnAttr(llvm::Attribute::NoUnwind);
+        func->setReturnDoesNotAlias();
     }
 
-    if (!(_TheModule->getFunction(IntrinsicFn::abort)))
+    if (!(_TheModule->getFunction(IntrinsicFn::arenaMark)))
     {
-        llvm::FunctionType *funcType = llvm::FunctionType::get(CreateLLVMType(Token::Type_void),
+        llvm::FunctionType *funcType = llvm::FunctionType::get(llvm::Type::getInt8PtrTy(_TheContext),
                                                                false);
-        llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                      IntrinsicFn::abort, _TheModule.get());
+        llvm::Function* func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                                      IntrinsicFn::arenaMark, _TheModule.get());
+        func->addFnAttr(llvm::Attribute::NoUnwind);
+    }
+
+    if (!(_TheModule->getFunction(IntrinsicFn::arenaRelease)))
+    {
+        llvm::FunctionType *funcType = llvm::FunctionType::get(llvm::Type::getVoidTy(_TheContext),
+                                                               {llvm::Type::getInt8PtrTy(_TheContext)},
+                                                               false);
+        llvm::Function* func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                                      IntrinsicFn::arenaRelease, _TheModule.get());
+        func->addFnAttr(llvm::Attribute::NoUnwind);
     }
 
     // stacksave, stackrestore used for dynamic array allocation/deallocation
@@ -189,25 +369,45 @@ void Visitor::CodegenVisitor::visit(AST::StmtBlockStmt *stmtBlock)
     for (auto &stmt : stmtBlock->stmt_list)
     {
         stmt->accept(this);
-        if ((returnStmt = dynamic_cast<AST::ReturnStmt*>(stmt.get()))) {
+        if ((returnStmt = dynamic_cast<AST::ReturnStmt*>(stmt))) {
             break; // no need to process other stmts now
         }
     }
 
+    // a nested block may have returned or aborted already, as the branch left
+    // of `if (true)' does; the arrays go out of scope with nothing to generate
+    bool terminated = _Builder.GetInsertBlock()->getTerminator();
+
+    // the arena goes back to the oldest mark going out of scope: that of this
+    // block's arrays, or on a return that of any array of the function
+    llvm::Value* arenaMark = nullptr;
+    if (returnStmt && !terminated) {
+        for (auto& decl : _arrayDecls) {
+            if ((arenaMark = decl.arenaMark))
+                break;
+        }
+    }
+
     // deallocate any array declaration
     while (!_arrayDecls.empty())
     {
-        auto decl = _arrayDecls.top();
-        if (decl.first != stmtBlock)
+        auto decl = _arrayDecls.back();
+        if (decl.scope != stmtBlock)
             break;
 
-        _Builder.CreateCall(_TheModule->getFunction("llvm.stackrestore"), {decl.second});
-        _arrayDecls.pop();
+        if (!terminated)
+            _Builder.CreateCall(_TheModule->getFunction("llvm.stackrestore"), {decl.stackSave});
+        if (decl.arenaMark && !returnStmt)
+            arenaMark = decl.arenaMark;
+        _arrayDecls.pop_back();
     }
+    if (arenaMark && !terminated)
+        _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::arenaRelease), {arenaMark});
 
     _scope.pop();
 
-    if (returnStmt) {
+    // a self tail call has already jumped back to the start instead
+    if (returnStmt && !terminated) {
         if (returnStmt->returnExpr)
             _Builder.CreateRet(returnStmt->returnExpr->llvmVal);
         else
@@ -220,8 +420,11 @@ void Visitor::CodegenVisitor::visit(AST::VarDeclStmt *stmt)
     llvm::Function* func = _Builder.GetInsertBlock()->getParent();
     for (auto& var : stmt->decls)
     {
-        llvm::AllocaInst* alloca = CreateEntryBlockAlloca(func, var.name, var.type);
+        llvm::AllocaInst* alloca = CreateEntryBlockAlloca(func, Interner::get().name(var.name), var.type);
+        // a declaration run again, in a loop, starts over from 0 too
+        _Builder.CreateStore(llvm::Constant::getNullValue(alloca->getAllocatedType()), alloca);
         _NamedValues[var.name] = alloca;
+        _varAllocas.push_back(alloca);
     }
 }
 
@@ -232,24 +435,47 @@ void Visitor::CodegenVisitor::visit(AST::ArrayDeclStmt *stmt)
     {
         var.expr->accept(this);
         llvm::Value* stacksavecall = _Builder.CreateCall(_TheModule->getFunction("llvm.stacksave"));
+        llvm::Value* arenaMark = nullptr;
+        if (!fitsOnStack(var.expr->llvmVal))
+            arenaMark = _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::arenaMark));
         AST::StmtBlockStmt* curScope = _scope.top();
-        _arrayDecls.push({curScope, stacksavecall});
-        llvm::AllocaInst* alloca = CreateAllocaArray(func, var.name, var.expr->llvmVal);
+        _arrayDecls.push_back({curScope, stacksavecall, arenaMark});
+        llvm::AllocaInst* alloca = CreateAllocaArray(func, Interner::get().name(var.name), var.expr->llvmVal);
         _NamedValues[var.name] = alloca;
     }
 }
 
 void Visitor::CodegenVisitor::visit(AST::PrintStmt *stmt)
 {
+    // The arguments are printed with one call, or one per run of them if
+    // evaluating one may print, read input or abort itself: what comes before
+    // it has to be out by then.
+    std::string kinds;
+    std::vector<llvm::Value*> args = {nullptr};
+    auto flushArgs = [&]() {
+        if (kinds.empty())
+            return;
+        args[0] = _Builder.CreateGlobalStringPtr(kinds, "printkinds");
+        _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::print), args);
+        kinds.clear();
+        args.resize(1);
+    };
+
     for (auto& arg : stmt->args) {
+        if (hasEffects(arg))
+            flushArgs();
         arg->accept(this);
-        if (auto strExpr = dynamic_cast<AST::StringLiteralExpr*>(arg.get())) {
-            _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::printstring), {strExpr->llvmVal});
+        if (auto strExpr = dynamic_cast<AST::StringLiteralExpr*>(arg)) {
+            kinds += 's';
+            args.push_back(arg->llvmVal);
+            args.push_back(llvm::ConstantInt::get(llvm::Type::getInt64Ty(_TheContext),
+                                                  Interner::get().name(strExpr->val).size()));
         } else {
-            arg->llvmVal = UpdateToIntWidth(arg->llvmVal, 64);
-            _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::printint), {arg->llvmVal});
+            kinds += 'i';
+            args.push_back(UpdateToIntWidth(arg->llvmVal, 64));
         }
     }
+    flushArgs();
 }
 
 void Visitor::CodegenVisitor::visit(AST::IfStmt *stmt)
@@ -295,6 +521,7 @@ void Visitor::CodegenVisitor::visit(AST::WhileStmt *stmt)
     llvm::BasicBlock* loopBody = llvm::BasicBlock::Create(_TheContext, "loop.body", func);
     llvm::BasicBlock* afterLoop = llvm::BasicBlock::Create(_TheContext, "loop.after", func);
 
+    hoistBoundsChecks(stmt->hoistedChecks);
     _Builder.CreateBr(loopHdr);
 
     _Builder.SetInsertPoint(loopHdr);
@@ -303,7 +530,9 @@ void Visitor::CodegenVisitor::visit(AST::WhileStmt *stmt)
 
     _Builder.SetInsertPoint(loopBody);
     stmt->body->accept(this);
-    _Builder.CreateBr(loopHdr);
+    // the body can end in a return or an abort, and then there's no back-edge
+    if (!_Builder.GetInsertBlock()->getTerminator())
+        _Builder.CreateBr(loopHdr);
 
     _Builder.SetInsertPoint(afterLoop);
 }
@@ -315,13 +544,14 @@ void Visitor::CodegenVisitor::visit(AST::ForStmt *stmt)
     llvm::BasicBlock* loopBody = llvm::BasicBlock::Create(_TheContext, "forloop.body", func);
     llvm::BasicBlock* afterLoop = llvm::BasicBlock::Create(_TheContext, "forloop.after", func);
 
-    AST::IdExpr* idExpr = dynamic_cast<AST::IdExpr*>(stmt->ident.get());
-    AST::IdExpr* contExpr = dynamic_cast<AST::IdExpr*>(stmt->container.get());
+    AST::IdExpr* idExpr = dynamic_cast<AST::IdExpr*>(stmt->ident);
+    AST::IdExpr* contExpr = dynamic_cast<AST::IdExpr*>(stmt->container);
     if (!idExpr || !contExpr)
         throw Exception("For stmt doesn't contain any valid id or container expr.");
 
-    // declare the variable in for statement
-    llvm::AllocaInst* forIdentAlloca = _Builder.CreateAlloca(CreateLLVMType(Token::Type_int), 0, idExpr->name);
+    // declare the variable in for statement; in the entry block like any other
+    // variable, so that an enclosing loop doesn't allocate it over and over
+    llvm::AllocaInst* forIdentAlloca = CreateEntryBlockAlloca(func, Interner::get().name(idExpr->name), Token::Type_int);
     _NamedValues[idExpr->name] = forIdentAlloca;
 
     llvm::Value* arrayAlloca = _NamedValues[contExpr->name];
@@ -329,33 +559,84 @@ void Visitor::CodegenVisitor::visit(AST::ForStmt *stmt)
     llvm::Value* dataPtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 1)});
     llvm::Value* data = _Builder.CreateLoad(dataPtr);
     llvm::Value* size = _Builder.CreateLoad(sizePtr);
-    llvm::Value* counterAlloca = _Builder.CreateAlloca(CreateLLVMType(Token::Type_int));
-    _Builder.CreateStore(llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), counterAlloca);
+    hoistBoundsChecks(stmt->hoistedChecks);
+    llvm::BasicBlock* preheader = _Builder.GetInsertBlock();
     _Builder.CreateBr(loopHdr);
 
-     // move to the loop header BB
+    // the counter is a phi rather than a variable in memory, which gives the
+    // loop the canonical shape the vectorizer looks for
     _Builder.SetInsertPoint(loopHdr);
-    llvm::Value* counterV = _Builder.CreateLoad(counterAlloca);
+    llvm::PHINode* counterV = _Builder.CreatePHI(CreateLLVMType(Token::Type_int), 2, "forloop.idx");
+    counterV->addIncoming(llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), preheader);
     llvm::Value* condV = _Builder.CreateICmpSLT(counterV, size);
     _Builder.CreateCondBr(condV, loopBody, afterLoop);
 
     _Builder.SetInsertPoint(loopBody);
     llvm::Value* elePtr = _Builder.CreateGEP(data, counterV);
-    _Builder.CreateStore(_Builder.CreateLoad(elePtr), _NamedValues[idExpr->name]);
+    _Builder.CreateStore(_Builder.CreateLoad(elePtr), forIdentAlloca);
     stmt->body->accept(this);
-    counterV = _Builder.CreateAdd(counterV, llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 1));
-    _Builder.CreateStore(counterV, counterAlloca);
-    _Builder.CreateBr(loopHdr);
+
+    // the body can end in a return, and then there's no back-edge
+    if (!_Builder.GetInsertBlock()->getTerminator()) {
+        // can't wrap, the counter stays below the size
+        llvm::Value* nextV = _Builder.CreateNSWAdd(counterV, llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 1), "forloop.next");
+        counterV->addIncoming(nextV, _Builder.GetInsertBlock());
+        llvm::BranchInst* backEdge = _Builder.CreateBr(loopHdr);
+
+        if (isVectorizable(stmt->body)) {
+            llvm::MDNode* vectorize = llvm::MDNode::get(_TheContext, {llvm::MDString::get(_TheContext, "llvm.loop.vectorize.enable"),
+                                                                      llvm::ConstantAsMetadata::get(llvm::ConstantInt::getTrue(_TheContext))});
+            // a loop id refers to itself
+            llvm::TempMDTuple placeholder = llvm::MDNode::getTemporary(_TheContext, llvm::None);
+            llvm::MDNode* loopID = llvm::MDNode::getDistinct(_TheContext, {placeholder.get(), vectorize});
+            loopID->replaceOperandWith(0, loopID);
+            backEdge->setMetadata(llvm::LLVMContext::MD_loop, loopID);
+        }
+    }
 
     _Builder.SetInsertPoint(afterLoop);
 }
 
 void Visitor::CodegenVisitor::visit(AST::ReturnStmt *stmt)
 {
+    auto call = dynamic_cast<AST::FnCallExpr*>(stmt->returnExpr);
+    if (call && call->tailCall == AST::TailCall::Self) {
+        CreateSelfTailCall(call);
+        return;
+    }
+
     if (stmt->returnExpr) {
         stmt->returnExpr->accept(this);
         stmt->returnExpr->llvmVal = UpdateToIntWidth(stmt->returnExpr->llvmVal, 64);
     }
+
+    if (call && call->tailCall == AST::TailCall::Sibling) {
+        // musttail is kept even without optimizations, but only for a call
+        // returned as it is by a function of the same type
+        auto callInst = llvm::cast<llvm::CallInst>(call->llvmVal);
+        llvm::Function* func = _Builder.GetInsertBlock()->getParent();
+        // and a callee that's inlined has no frame to begin with
+        bool mustTail = stmt->returnExpr->llvmVal == callInst &&
+                        callInst->getFunctionType() == func->getFunctionType() &&
+                        !callInst->getCalledFunction()->hasFnAttribute(llvm::Attribute::AlwaysInline);
+        callInst->setTailCallKind(mustTail ? llvm::CallInst::TCK_MustTail : llvm::CallInst::TCK_Tail);
+    }
+}
+
+void Visitor::CodegenVisitor::CreateSelfTailCall(AST::FnCallExpr* expr)
+{
+    // every argument is evaluated before any parameter changes
+    std::vector<llvm::Value*> llvmArgs;
+    for (auto& arg : expr->fnArgs) {
+        arg->accept(this);
+        llvmArgs.push_back(arg->llvmVal);
+    }
+    for (size_t i = 0; i < llvmArgs.size(); i++)
+        _Builder.CreateStore(llvmArgs[i], _paramAllocas[i]);
+
+    // the variables are zeroed in front of it once the whole function is
+    // generated, the ones declared after this point included
+    _tailRecurseJumps.push_back(_Builder.CreateBr(_tailRecurseBB));
 }
 
 void Visitor::CodegenVisitor::visit(AST::AbortStmt *stmt)
@@ -364,20 +645,91 @@ void Visitor::CodegenVisitor::visit(AST::AbortStmt *stmt)
     _Builder.CreateUnreachable();
 }
 
-void Visitor::CodegenVisitor::visit(AST::ArrayAssignment *stmt)
+void Visitor::CodegenVisitor::hoistBoundsChecks(const ArenaArray<AST::BaseStmt*>& accesses)
 {
-    stmt->idxExpr->accept(this);
-    llvm::Value* arrayAlloca = _NamedValues[stmt->name];
+    for (auto access : accesses) {
+        Symbol arrayName;
+        AST::BaseExpr* idxExpr;
+        if (auto arrayExpr = dynamic_cast<AST::ArrayExpr*>(access)) {
+            arrayName = arrayExpr->name;
+            idxExpr = arrayExpr->expr;
+        } else if (auto arrayAssignment = dynamic_cast<AST::ArrayAssignment*>(access)) {
+            arrayName = arrayAssignment->name;
+            idxExpr = arrayAssignment->idxExpr;
+        } else {
+            throw Exception("codegen: hoisted bounds check of something else than an array access");
+        }
+
+        idxExpr->accept(this);
+        _hoistedChecks[access] = CreateInBounds(_NamedValues[arrayName], idxExpr->llvmVal);
+    }
+}
 
+llvm::Value* Visitor::CodegenVisitor::CreateInBounds(llvm::Value* arrayAlloca, llvm::Value* idx)
+{
     llvm::Value* sizePtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 0)});
     llvm::Value* size = _Builder.CreateLoad(sizePtr);
+    // a negative index is a huge unsigned one, so one compare covers both ends
+    if (Lilang::Settings::get().isOn("compact-bounds-checks"))
+        return _Builder.CreateICmpULT(idx, size, "inbounds");
 
-    llvm::Value* dataPtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 1)});
-    llvm::Value* data = _Builder.CreateLoad(dataPtr);
+    llvm::Value* arrayLessThan = _Builder.CreateICmpSLT(idx, size);
+    llvm::Value* arrayGreaterThan = _Builder.CreateICmpSGE(idx, llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0));
+    return _Builder.CreateAnd(arrayLessThan, arrayGreaterThan, "inbounds");
+}
+
+void Visitor::CodegenVisitor::CreateBranchToOutOfBounds(llvm::Value* inBounds, int line)
+{
+    llvm::Function* func = _Builder.GetInsertBlock()->getParent();
+    if (!_outOfBoundsBB) {
+        // added to the function once its body is done, so that it comes last
+        _outOfBoundsBB = llvm::BasicBlock::Create(_TheContext, "outofbounds");
+        llvm::IRBuilder<> trapB(_outOfBoundsBB);
+        _outOfBoundsLine = trapB.CreatePHI(llvm::Type::getInt64Ty(_TheContext), 0, "line");
+        trapB.CreateCall(_TheModule->getFunction(IntrinsicFn::outOfBounds), {_outOfBoundsLine});
+        trapB.CreateUnreachable();
+    }
 
-    llvm::Value* arrayLessThan = _Builder.CreateICmpSLT(stmt->idxExpr->llvmVal, size);
+    llvm::BasicBlock* passBB = llvm::BasicBlock::Create(_TheContext, "inboundsbb", func);
+    _Builder.CreateCondBr(inBounds, passBB, _outOfBoundsBB,
+                          llvm::MDBuilder(_TheContext).createBranchWeights(2000, 1));
+    _outOfBoundsLine->addIncoming(llvm::ConstantInt::get(llvm::Type::getInt64Ty(_TheContext), line),
+                                  _Builder.GetInsertBlock());
+    _Builder.SetInsertPoint(passBB);
+}
+
+void Visitor::CodegenVisitor::CreateBoundsCheck(AST::BaseStmt* access, AST::BoundsCheck check,
+                                                llvm::Value* arrayAlloca, llvm::Value* idx, int line)
+{
+    if (check == AST::BoundsCheck::None)
+        return;
+
+    if (Lilang::Settings::get().isOn("compact-bounds-checks")) {
+        llvm::Value* inBounds = check == AST::BoundsCheck::Hoisted ? _hoistedChecks.at(access)
+                                                                   : CreateInBounds(arrayAlloca, idx);
+        CreateBranchToOutOfBounds(inBounds, line);
+        return;
+    }
 
     llvm::Function* func = _Builder.GetInsertBlock()->getParent();
+    if (check == AST::BoundsCheck::Hoisted) {
+        llvm::BasicBlock* failBB = llvm::BasicBlock::Create(_TheContext, "failbb", func);
+        llvm::BasicBlock* fullyPassBB = llvm::BasicBlock::Create(_TheContext, "fullypassbb", func);
+        _Builder.CreateCondBr(_hoistedChecks.at(access), fullyPassBB, failBB);
+
+        _Builder.SetInsertPoint(failBB);
+        _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::abort));
+        _Builder.CreateUnreachable();
+
+        _Builder.SetInsertPoint(fullyPassBB);
+        return;
+    }
+
+    llvm::Value* sizePtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 0)});
+    llvm::Value* size = _Builder.CreateLoad(sizePtr);
+
+    llvm::Value* arrayLessThan = _Builder.CreateICmpSLT(idx, size);
+
     llvm::BasicBlock* gt0checkBB = llvm::BasicBlock::Create(_TheContext, "gt0checkbb", func);
     llvm::BasicBlock* failBB = llvm::BasicBlock::Create(_TheContext, "failbb", func);
     llvm::BasicBlock* fullyPassBB = llvm::BasicBlock::Create(_TheContext, "fullypassbb", func);
@@ -389,11 +741,20 @@ void Visitor::CodegenVisitor::visit(AST::ArrayAssignment *stmt)
     _Builder.CreateUnreachable();
 
     _Builder.SetInsertPoint(gt0checkBB);
-    llvm::Value* arrayGreaterThan = _Builder.CreateICmpSGE(stmt->idxExpr->llvmVal, llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0));
+    llvm::Value* arrayGreaterThan = _Builder.CreateICmpSGE(idx, llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0));
     _Builder.CreateCondBr(arrayGreaterThan, fullyPassBB, failBB);
 
     _Builder.SetInsertPoint(fullyPassBB);
+}
 
+void Visitor::CodegenVisitor::visit(AST::ArrayAssignment *stmt)
+{
+    stmt->idxExpr->accept(this);
+    llvm::Value* arrayAlloca = _NamedValues[stmt->name];
+    CreateBoundsCheck(stmt, stmt->boundsCheck, arrayAlloca, stmt->idxExpr->llvmVal, stmt->line);
+
+    llvm::Value* dataPtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 1)});
+    llvm::Value* data = _Builder.CreateLoad(dataPtr);
     llvm::Value* elePtr = _Builder.CreateGEP(data, stmt->idxExpr->llvmVal);
     stmt->expr->accept(this);
     _Builder.CreateStore(stmt->expr->llvmVal, elePtr);
@@ -442,20 +803,54 @@ void Visitor::CodegenVisitor::visit(AST::LiteralExpr *expr)
 
 void Visitor::CodegenVisitor::visit(AST::StringLiteralExpr *expr)
 {
-    expr->llvmVal = _Builder.CreateGlobalStringPtr(expr->val);
+    expr->llvmVal = _Builder.CreateGlobalStringPtr(Interner::get().name(expr->val));
 }
 
 void Visitor::CodegenVisitor::visit(AST::TernaryExpr* expr)
 {
     expr->condExpr->accept(this);
+    llvm::Value* condV = expr->condExpr->llvmVal;
+
+    // both arms are evaluated if that's cheaper than branching over them
+    if (isCheap(expr->trueExpr) && isCheap(expr->falseExpr)) {
+        expr->trueExpr->accept(this);
+        expr->falseExpr->accept(this);
+        expr->llvmVal = _Builder.CreateSelect(condV, expr->trueExpr->llvmVal, expr->falseExpr->llvmVal);
+        return;
+    }
+
+    llvm::Function* func = _Builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock* trueBB = llvm::BasicBlock::Create(_TheContext, "cond.true", func);
+    llvm::BasicBlock* falseBB = llvm::BasicBlock::Create(_TheContext, "cond.false", func);
+    llvm::BasicBlock* mergeBB = llvm::BasicBlock::Create(_TheContext, "cond.end", func);
+    _Builder.CreateCondBr(condV, trueBB, falseBB);
+
+    // evaluating an arm may leave us in another block than it started in
+    _Builder.SetInsertPoint(trueBB);
     expr->trueExpr->accept(this);
+    trueBB = _Builder.GetInsertBlock();
+    _Builder.CreateBr(mergeBB);
+
+    _Builder.SetInsertPoint(falseBB);
     expr->falseExpr->accept(this);
-    expr->llvmVal = _Builder.CreateSelect(expr->condExpr->llvmVal, expr->trueExpr->llvmVal, expr->falseExpr->llvmVal);
+    falseBB = _Builder.GetInsertBlock();
+    _Builder.CreateBr(mergeBB);
+
+    _Builder.SetInsertPoint(mergeBB);
+    llvm::PHINode* phi = _Builder.CreatePHI(expr->trueExpr->llvmVal->getType(), 2);
+    phi->addIncoming(expr->trueExpr->llvmVal, trueBB);
+    phi->addIncoming(expr->falseExpr->llvmVal, falseBB);
+    expr->llvmVal = phi;
 }
 
 void Visitor::CodegenVisitor::visit(AST::BinopExpr* expr)
 {
     const Token op = expr->op;
+    if ((op == Token::Op_and || op == Token::Op_or) && Lilang::Settings::get().isOn("short-circuit")) {
+        CreateShortCircuit(expr);
+        return;
+    }
+
     expr->leftExpr->accept(this);
     expr->rightExpr->accept(this);
     llvm::Value* lhsV = expr->leftExpr->llvmVal;
@@ -504,15 +899,110 @@ void Visitor::CodegenVisitor::visit(AST::BinopExpr* expr)
             expr->llvmVal = _Builder.CreateSRem(lhsV, rhsV);
             break;
         case Token::Op_exp:
-        {
-            expr->llvmVal = _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::pow), {lhsV, rhsV});
-        }
-        break;
+            expr->llvmVal = CreatePow(lhsV, rhsV);
+            break;
         default:
             throw Exception("codegen: binop not handled");
     }
 }
 
+void Visitor::CodegenVisitor::CreateShortCircuit(AST::BinopExpr* expr)
+{
+    const bool isAnd = expr->op == Token::Op_and;
+    expr->leftExpr->accept(this);
+    llvm::Value* lhsV = expr->leftExpr->llvmVal;
+    // the value of the whole expression when the right side isn't needed
+    llvm::Value* decided = llvm::ConstantInt::get(llvm::Type::getInt1Ty(_TheContext), !isAnd);
+
+    if (isCheap(expr->rightExpr)) {
+        expr->rightExpr->accept(this);
+        llvm::Value* rhsV = expr->rightExpr->llvmVal;
+        expr->llvmVal = isAnd ? _Builder.CreateSelect(lhsV, rhsV, decided)
+                              : _Builder.CreateSelect(lhsV, decided, rhsV);
+        return;
+    }
+
+    llvm::Function* func = _Builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock* lhsBB = _Builder.GetInsertBlock();
+    llvm::BasicBlock* rhsBB = llvm::BasicBlock::Create(_TheContext, isAnd ? "and.rhs" : "or.rhs", func);
+    llvm::BasicBlock* mergeBB = llvm::BasicBlock::Create(_TheContext, isAnd ? "and.end" : "or.end", func);
+    if (isAnd)
+        _Builder.CreateCondBr(lhsV, rhsBB, mergeBB);
+    else
+        _Builder.CreateCondBr(lhsV, mergeBB, rhsBB);
+
+    _Builder.SetInsertPoint(rhsBB);
+    expr->rightExpr->accept(this);
+    llvm::Value* rhsV = expr->rightExpr->llvmVal;
+    // evaluating it may have left us in another block
+    rhsBB = _Builder.GetInsertBlock();
+    _Builder.CreateBr(mergeBB);
+
+    _Builder.SetInsertPoint(mergeBB);
+    llvm::PHINode* phi = _Builder.CreatePHI(llvm::Type::getInt1Ty(_TheContext), 2);
+    phi->addIncoming(decided, lhsBB);
+    phi->addIncoming(rhsV, rhsBB);
+    expr->llvmVal = phi;
+}
+
+llvm::Value* Visitor::CodegenVisitor::CreatePow(llvm::Value* base, llvm::Value* exp)
+{
+    llvm::Type* intType = base->getType();
+    unsigned width = intType->getIntegerBitWidth();
+
+    // square-and-multiply unrolled over the bits of a constant exponent,
+    // starting from the highest one
+    if (auto constExp = llvm::dyn_cast<llvm::ConstantInt>(exp)) {
+        const llvm::APInt& n = constExp->getValue();
+        if (n == 0)
+            return llvm::ConstantInt::get(intType, 1);
+        llvm::Value* result = base;
+        for (int bit = static_cast<int>(n.getActiveBits()) - 2; bit >= 0; bit--) {
+            result = _Builder.CreateMul(result, result);
+            if (n[bit])
+                result = _Builder.CreateMul(result, base);
+        }
+        return result;
+    }
+
+    // powers of 2 are a shift, and 0 once the bit is shifted out
+    if (auto constBase = llvm::dyn_cast<llvm::ConstantInt>(base)) {
+        if (constBase->getValue() == 2) {
+            llvm::Value* inRange = _Builder.CreateICmpULT(exp, llvm::ConstantInt::get(intType, width));
+            return _Builder.CreateSelect(inRange, _Builder.CreateShl(llvm::ConstantInt::get(intType, 1), exp),
+                                         llvm::ConstantInt::get(intType, 0));
+        }
+    }
+
+    // square-and-multiply over the bits of the exponent, lowest first, at most
+    // `width' iterations
+    llvm::Function* func = _Builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock* preheader = _Builder.GetInsertBlock();
+    llvm::BasicBlock* condBB = llvm::BasicBlock::Create(_TheContext, "pow.cond", func);
+    llvm::BasicBlock* bodyBB = llvm::BasicBlock::Create(_TheContext, "pow.body", func);
+    llvm::BasicBlock* endBB = llvm::BasicBlock::Create(_TheContext, "pow.end", func);
+    _Builder.CreateBr(condBB);
+
+    _Builder.SetInsertPoint(condBB);
+    llvm::PHINode* result = _Builder.CreatePHI(intType, 2, "pow.result");
+    llvm::PHINode* square = _Builder.CreatePHI(intType, 2, "pow.square");
+    llvm::PHINode* bits = _Builder.CreatePHI(intType, 2, "pow.bits");
+    result->addIncoming(llvm::ConstantInt::get(intType, 1), preheader);
+    square->addIncoming(base, preheader);
+    bits->addIncoming(exp, preheader);
+    _Builder.CreateCondBr(_Builder.CreateICmpEQ(bits, llvm::ConstantInt::get(intType, 0)), endBB, bodyBB);
+
+    _Builder.SetInsertPoint(bodyBB);
+    llvm::Value* odd = _Builder.CreateTrunc(bits, llvm::Type::getInt1Ty(_TheContext));
+    result->addIncoming(_Builder.CreateSelect(odd, _Builder.CreateMul(result, square), result), bodyBB);
+    square->addIncoming(_Builder.CreateMul(square, square), bodyBB);
+    bits->addIncoming(_Builder.CreateLShr(bits, 1), bodyBB);
+    _Builder.CreateBr(condBB);
+
+    _Builder.SetInsertPoint(endBB);
+    return result;
+}
+
 void Visitor::CodegenVisitor::visit(AST::UnaryExpr *expr)
 {
     const Token op = expr->type;
@@ -532,7 +1022,7 @@ void Visitor::CodegenVisitor::visit(AST::UnaryExpr *expr)
 
 void Visitor::CodegenVisitor::visit(AST::SizeofExpr *expr)
 {
-    AST::IdExpr* arrId = dynamic_cast<AST::IdExpr*>(expr->idExpr.get());
+    AST::IdExpr* arrId = dynamic_cast<AST::IdExpr*>(expr->idExpr);
     if (!arrId)
         throw Exception("found unexpected array identifier");
 
@@ -551,30 +1041,10 @@ void Visitor::CodegenVisitor::visit(AST::ArrayExpr *expr)
 {
     expr->expr->accept(this);
     llvm::Value* arrayAlloca = _NamedValues[expr->name];
-    llvm::Value* sizePtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 0)});
-    llvm::Value* size = _Builder.CreateLoad(sizePtr);
+    CreateBoundsCheck(expr, expr->boundsCheck, arrayAlloca, expr->expr->llvmVal, expr->line);
 
     llvm::Value* dataPtr = _Builder.CreateGEP(arrayAlloca, {llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0), llvm::ConstantInt::get(llvm::Type::getInt32Ty(_TheContext), 1)});
     llvm::Value* data = _Builder.CreateLoad(dataPtr);
-
-    llvm::Value* arrayLessThan = _Builder.CreateICmpSLT(expr->expr->llvmVal, size);
-
-    llvm::Function* func = _Builder.GetInsertBlock()->getParent();
-    llvm::BasicBlock* gt0checkBB = llvm::BasicBlock::Create(_TheContext, "gt0checkbb", func);
-    llvm::BasicBlock* failBB = llvm::BasicBlock::Create(_TheContext, "failbb", func);
-    llvm::BasicBlock* fullyPassBB = llvm::BasicBlock::Create(_TheContext, "fullypassbb", func);
-
-    _Builder.CreateCondBr(arrayLessThan, gt0checkBB, failBB);
-
-    _Builder.SetInsertPoint(failBB);
-    _Builder.CreateCall(_TheModule->getFunction(IntrinsicFn::abort));
-    _Builder.CreateUnreachable();
-
-    _Builder.SetInsertPoint(gt0checkBB);
-    llvm::Value* arrayGreaterThan = _Builder.CreateICmpSGE(expr->expr->llvmVal, llvm::ConstantInt::get(CreateLLVMType(Token::Type_int), 0));
-    _Builder.CreateCondBr(arrayGreaterThan, fullyPassBB, failBB);
-
-    _Builder.SetInsertPoint(fullyPassBB);
     llvm::Value* elePtr = _Builder.CreateGEP(data, expr->expr->llvmVal);
     expr->llvmVal = _Builder.CreateLoad(elePtr);
 }
@@ -582,8 +1052,9 @@ void Visitor::CodegenVisitor::visit(AST::ArrayExpr *expr)
 void Visitor::CodegenVisitor::visit(AST::FnCallExpr *expr)
 {
     llvm::Function* func = nullptr;
-    if(!(func = _TheModule->getFunction(expr->name)))
-        throw Exception("Cannot find func : " + expr->name);
+    const std::string& name = Interner::get().name(expr->name);
+    if(!(func = _TheModule->getFunction(name)))
+        throw Exception("Cannot find func : " + name);
 
     std::vector<llvm::Value*> llvmArgs;
     // codegen all function args
@@ -595,15 +1066,16 @@ void Visitor::CodegenVisitor::visit(AST::FnCallExpr *expr)
     expr->llvmVal = _Builder.CreateCall(func, llvmArgs);
 }
 
-void Visitor::CodegenVisitor::visit(AST::Program* program)
+void Visitor::CodegenVisitor::declareFunctions(AST::Program* program)
 {
     declareRuntimeFns();
     // add functions to symbol table in first pass
     for (auto &fnDef : program->fnDefinitions)
     {
-        llvm::Function* func = _TheModule->getFunction(fnDef->proto->fnName);
+        const std::string& fnName = Interner::get().name(fnDef->proto->fnName);
+        llvm::Function* func = _TheModule->getFunction(fnName);
         if (func)
-            throw Exception("Function name " + fnDef->proto->fnName + " already exist in llvm module");
+            throw Exception("Function name " + fnName + " already exist in llvm module");
 
         std::vector<llvm::Type *> argTypes;
         for (auto &param : fnDef->proto->fnParams)
@@ -614,14 +1086,73 @@ void Visitor::CodegenVisitor::visit(AST::Program* program)
         }
 
         llvm::FunctionType* ft = llvm::FunctionType::get(CreateLLVMType(fnDef->proto->fnType), argTypes, false);
-        func = llvm::Function::Create(ft, llvm::Function::PrivateLinkage, fnDef->proto->fnName, _TheModule.get());
+        func = llvm::Function::Create(ft, llvm::Function::PrivateLinkage, fnName, _TheModule.get());
+        if (fnDef->alwaysInline)
+            func->addFnAttr(llvm::Attribute::AlwaysInline);
 
         // set names for func params
         unsigned idx = 0;
         for (auto& arg : func->args()) {
-            arg.setName(fnDef->proto->fnParams[idx++].name);
+            arg.setName(Interner::get().name(fnDef->proto->fnParams[idx++].name));
         }
     }
+}
+
+bool Visitor::CodegenVisitor::generateFunction(AST::FunctionDefinition* fnDef)
+{
+    llvm::Function* func = _TheModule->getFunction(Interner::get().name(fnDef->proto->fnName));
+    if (!func)
+        assert(false && "Impossible that we couldn't find function in the module here");
+
+    llvm::BasicBlock* bb = llvm::BasicBlock::Create(_TheContext, "entry", func);
+    _Builder.SetInsertPoint(bb);
+
+    _NamedValues.clear();
+    _outOfBoundsBB = nullptr;
+    _paramAllocas.clear();
+    _varAllocas.clear();
+    _tailRecurseJumps.clear();
+    unsigned idx = 0;
+    for(auto& arg : func->args())
+    {
+        const AST::FnParam& param = fnDef->proto->fnParams[idx++];
+        llvm::AllocaInst* alloca = CreateEntryBlockAlloca(func,
+                                                          arg.getName(),
+                                                          param.type);
+        _Builder.CreateStore(&arg, alloca);
+        _NamedValues[param.name] = alloca;
+        _paramAllocas.push_back(alloca);
+    }
+
+    _tailRecurseBB = nullptr;
+    if (fnDef->selfTailCalls) {
+        _tailRecurseBB = llvm::BasicBlock::Create(_TheContext, "tailrecurse", func);
+        _Builder.CreateBr(_tailRecurseBB);
+        _Builder.SetInsertPoint(_tailRecurseBB);
+    }
+
+    fnDef->body->accept(this);
+
+    // for non-void functions, typechecker should have already rejected programs without
+    // return/abort statements at end of the function.
+    if (!_Builder.GetInsertBlock()->getTerminator() && fnDef->proto->fnType == Token::Type_void) {
+        _Builder.CreateRetVoid();
+    }
+    // a fresh call starts with its variables zeroed, and so does every
+    // iteration of the loop the self tail calls make
+    for (llvm::BranchInst* jump : _tailRecurseJumps) {
+        _Builder.SetInsertPoint(jump);
+        for (llvm::AllocaInst* alloca : _varAllocas)
+            _Builder.CreateStore(llvm::Constant::getNullValue(alloca->getAllocatedType()), alloca);
+    }
+    if (_outOfBoundsBB)
+        func->getBasicBlockList().push_back(_outOfBoundsBB);
+    return llvm::verifyFunction(*func, &llvm::errs());
+}
+
+void Visitor::CodegenVisitor::visit(AST::Program* program)
+{
+    declareFunctions(program);
 
     // set 'main' linkage to external
     _TheModule->getFunction("main")->setLinkage(llvm::Function::ExternalLinkage);
@@ -629,37 +1160,152 @@ void Visitor::CodegenVisitor::visit(AST::Program* program)
     bool err = false;
     // iterate over individual funcs
     for (auto& fnDef : program->fnDefinitions)
-    {
-        llvm::Function* func = _TheModule->getFunction(fnDef->proto->fnName);
-        if (!func)
-            assert(false && "Impossible that we couldn't find function in the module here");
+        err = generateFunction(fnDef) || err;
+    if (!err && Lilang::Settings::get().getOptLevel() > 0)
+        specializeCalls(program);
 
-        llvm::BasicBlock* bb = llvm::BasicBlock::Create(_TheContext, "entry", func);
-        _Builder.SetInsertPoint(bb);
+    err = llvm::verifyModule(*_TheModule.get(), &llvm::errs()) || err;
+    if (err) {
+        throw Exception("LLVM IR verification failed.");
+    }
+}
 
-        _NamedValues.clear();
-        unsigned idx = 0;
-        for(auto& arg : func->args())
-        {
-            llvm::AllocaInst* alloca = CreateEntryBlockAlloca(func,
-                                                              arg.getName(),
-                                                              fnDef->proto->fnParams[idx++].type);
-            _Builder.CreateStore(&arg, alloca);
-            _NamedValues[arg.getName()] = alloca;
+void Visitor::CodegenVisitor::specializeCalls(AST::Program* program)
+{
+    std::unordered_set<llvm::Function*> candidates;
+    for (auto& fnDef : program->fnDefinitions) {
+        if (!fnDef->specialize)
+            continue;
+        llvm::Function* func = _TheModule->getFunction(Interner::get().name(fnDef->proto->fnName));
+        // a copy has fewer parameters, which its musttail calls need to keep
+        bool mustTailCalls = false;
+        for (auto& bb : *func) {
+            for (auto& inst : bb) {
+                auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                mustTailCalls = mustTailCalls || (call && call->isMustTailCall());
+            }
         }
+        if (!mustTailCalls)
+            candidates.insert(func);
+    }
 
-        fnDef->body->accept(this);
+    std::vector<llvm::CallInst*> calls;
+    for (auto& func : *_TheModule) {
+        for (auto& bb : func) {
+            for (auto& inst : bb) {
+                auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                if (!call || call->isMustTailCall() || !candidates.count(call->getCalledFunction()))
+                    continue;
+                if (std::any_of(call->arg_begin(), call->arg_end(),
+                                [](const llvm::Use& arg) { return llvm::isa<llvm::ConstantInt>(arg); }))
+                    calls.push_back(call);
+            }
+        }
+    }
 
-        // for non-void functions, typechecker should have already rejected programs without
-        // return/abort statements at end of the function.
-        if (!_Builder.GetInsertBlock()->getTerminator() && fnDef->proto->fnType == Token::Type_void) {
-            _Builder.CreateRetVoid();
+    // the copies made so far, by the function and the constant passed for each
+    // of its parameters, or null for the ones still passed
+    std::map<std::pair<llvm::Function*, std::vector<llvm::Constant*>>, llvm::Function*> copies;
+    std::unordered_map<llvm::Function*, unsigned> numCopies;
+    const unsigned maxCopies = 4;
+    for (llvm::CallInst* call : calls) {
+        llvm::Function* callee = call->getCalledFunction();
+        std::vector<llvm::Constant*> constArgs;
+        std::vector<llvm::Value*> args;
+        for (auto& arg : llvm::make_range(call->arg_begin(), call->arg_end())) {
+            auto constArg = llvm::dyn_cast<llvm::ConstantInt>(arg);
+            constArgs.push_back(constArg);
+            if (!constArg)
+                args.push_back(arg);
+        }
+
+        llvm::Function*& copy = copies[{callee, constArgs}];
+        if (!copy) {
+            if (numCopies[callee] == maxCopies)
+                continue;
+            numCopies[callee]++;
+            llvm::ValueToValueMapTy paramValues;
+            auto param = callee->arg_begin();
+            for (llvm::Constant* constArg : constArgs) {
+                if (constArg)
+                    paramValues[&*param] = constArg;
+                ++param;
+            }
+            // private like the original, and dropped by the optimizer if every
+            // call of it ends up inlined
+            copy = llvm::CloneFunction(callee, paramValues);
+            copy->setName(callee->getName() + ".spec");
         }
-        err = llvm::verifyFunction(*func, &llvm::errs());
+
+        llvm::CallInst* newCall = llvm::CallInst::Create(copy, args, "", call);
+        newCall->setTailCallKind(call->getTailCallKind());
+        call->replaceAllUsesWith(newCall);
+        call->eraseFromParent();
     }
+}
+
+void Visitor::CodegenVisitor::generate(AST::Program* program,
+                                       const std::vector<AST::FunctionDefinition*>& fnDefs)
+{
+    declareFunctions(program);
+
+    // the functions generated here are looked up by name once compiled, and the
+    // others have their code in some other module
+    for (auto& fnDef : program->fnDefinitions)
+        _TheModule->getFunction(Interner::get().name(fnDef->proto->fnName))->setLinkage(llvm::Function::ExternalLinkage);
+
+    bool err = false;
+    for (auto& fnDef : fnDefs)
+        err = generateFunction(fnDef) || err;
 
     err = llvm::verifyModule(*_TheModule.get(), &llvm::errs()) || err;
     if (err) {
         throw Exception("LLVM IR verification failed.");
     }
-}
\ No newline at end of file
+}
+
+std::string Visitor::CodegenVisitor::generateEntryPoint(AST::FunctionDefinition* fnDef)
+{
+    const std::string& fnName = Interner::get().name(fnDef->proto->fnName);
+    llvm::Function* func = _TheModule->getFunction(fnName);
+    llvm::Type* int64Type = llvm::Type::getInt64Ty(_TheContext);
+    llvm::FunctionType* ft = llvm::FunctionType::get(int64Type, {int64Type->getPointerTo()}, false);
+    std::string entryName = "lilang.entry." + fnName;
+    llvm::Function* entry = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, entryName, _TheModule.get());
+
+    llvm::BasicBlock* bb = llvm::BasicBlock::Create(_TheContext, "entry", entry);
+    _Builder.SetInsertPoint(bb);
+
+    // every argument takes one int64 slot; arrays are passed as pointers to them
+    llvm::Value* slots = &*entry->arg_begin();
+    std::vector<llvm::Value*> args;
+    unsigned idx = 0;
+    for (auto& param : fnDef->proto->fnParams)
+    {
+        llvm::Value* slotPtr = _Builder.CreateGEP(slots, llvm::ConstantInt::get(int64Type, idx++));
+        llvm::Value* slot = _Builder.CreateLoad(slotPtr);
+        if (param.type == Token::Type_bool) {
+            args.push_back(_Builder.CreateTrunc(slot, llvm::Type::getInt1Ty(_TheContext)));
+        } else if (param.type == Token::Type_array) {
+            llvm::Value* arrayPtr = _Builder.CreateIntToPtr(slot, CreateLLVMType(Token::Type_array)->getPointerTo());
+            args.push_back(_Builder.CreateLoad(arrayPtr));
+        } else {
+            args.push_back(UpdateToIntWidth(slot, Lilang::Settings::get().getWidth()));
+        }
+    }
+
+    llvm::Value* result = _Builder.CreateCall(func, args);
+    if (fnDef->proto->fnType == Token::Type_void)
+        _Builder.CreateRet(llvm::ConstantInt::get(int64Type, 0));
+    else if (fnDef->proto->fnType == Token::Type_bool)
+        _Builder.CreateRet(_Builder.CreateZExt(result, int64Type));
+    else
+        _Builder.CreateRet(UpdateToIntWidth(result, 64));
+    return entryName;
+}
+
+void Visitor::CodegenVisitor::createModule(const std::string& name)
+{
+    _TheModule = llvm::make_unique<llvm::Module>(name, _TheContext);
+    _NamedValues.clear();
+}
@@ -0,0 +1,370 @@
+#include <climits>
+
+#include "utils.hpp"
+#include "baseast.hpp"
+#include "visitor.hpp"
+
+namespace {
+    bool isIntConst(AST::BaseExpr* expr, int64_t& val)
+    {
+        auto numExpr = dynamic_cast<AST::NumExpr*>(expr);
+        if (numExpr)
+            val = numExpr->val;
+        return numExpr;
+    }
+
+    bool isBoolConst(AST::BaseExpr* expr, bool& val)
+    {
+        if (dynamic_cast<AST::TrueExpr*>(expr))
+            val = true;
+        else if (dynamic_cast<AST::FalseExpr*>(expr))
+            val = false;
+        else
+            return false;
+        return true;
+    }
+
+    // Whether evaluating `expr' does nothing but compute a value: it can't
+    // call a function, read input, go out of bounds or divide by zero.
+    bool isPure(AST::BaseExpr* expr)
+    {
+        if (auto binopExpr = dynamic_cast<AST::BinopExpr*>(expr))
+            return binopExpr->op != Token::Op_divide && binopExpr->op != Token::Op_mod &&
+                   isPure(binopExpr->leftExpr) && isPure(binopExpr->rightExpr);
+        if (auto unaryExpr = dynamic_cast<AST::UnaryExpr*>(expr))
+            return isPure(unaryExpr->expr);
+        if (auto ternaryExpr = dynamic_cast<AST::TernaryExpr*>(expr))
+            return isPure(ternaryExpr->condExpr) && isPure(ternaryExpr->trueExpr) &&
+                   isPure(ternaryExpr->falseExpr);
+        return !dynamic_cast<AST::FnCallExpr*>(expr) && !dynamic_cast<AST::InputExpr*>(expr) &&
+               !dynamic_cast<AST::ArrayExpr*>(expr);
+    }
+
+    // whether nothing after `stmt' in its block can run
+    bool endsBlock(AST::BaseStmt* stmt)
+    {
+        if (auto stmtBlock = dynamic_cast<AST::StmtBlockStmt*>(stmt))
+            return !stmtBlock->stmt_list.empty() && endsBlock(stmtBlock->stmt_list.back());
+        return dynamic_cast<AST::ReturnStmt*>(stmt) || dynamic_cast<AST::AbortStmt*>(stmt);
+    }
+}
+
+AST::BaseExpr* Visitor::ConstantFoldVisitor::fold(AST::BaseExpr* expr)
+{
+    _expr = expr;
+    expr->accept(this);
+    return _expr;
+}
+
+int64_t Visitor::ConstantFoldVisitor::wrap(uint64_t val) const
+{
+    if (_width >= 64)
+        return static_cast<int64_t>(val);
+    unsigned shift = 64 - _width;
+    return static_cast<int64_t>(val << shift) >> shift;
+}
+
+AST::BaseExpr* Visitor::ConstantFoldVisitor::makeInt(int64_t val)
+{
+    if (val < INT_MIN || val > INT_MAX)
+        return nullptr;
+    AST::BaseExpr* expr = _arena->make<AST::NumExpr>(static_cast<int>(val));
+    expr->result = AST::createValue(Token::Type_int);
+    return expr;
+}
+
+AST::BaseExpr* Visitor::ConstantFoldVisitor::makeBool(bool val)
+{
+    AST::BaseExpr* expr = val ? static_cast<AST::BaseExpr*>(_arena->make<AST::TrueExpr>())
+                              : static_cast<AST::BaseExpr*>(_arena->make<AST::FalseExpr>());
+    expr->result = AST::createValue(Token::Type_bool);
+    return expr;
+}
+
+AST::BaseExpr* Visitor::ConstantFoldVisitor::foldInts(Token op, int64_t lhs, int64_t rhs)
+{
+    // the literals are narrowed to the int type first, like codegen does
+    lhs = wrap(lhs);
+    rhs = wrap(rhs);
+    uint64_t ulhs = static_cast<uint64_t>(lhs);
+    uint64_t urhs = static_cast<uint64_t>(rhs);
+    int64_t min = wrap(uint64_t(1) << (_width - 1));
+
+    switch (op) {
+        case Token::Op_neq:   return makeBool(lhs != rhs);
+        case Token::Op_eqeq:  return makeBool(lhs == rhs);
+        case Token::Op_gt:    return makeBool(lhs > rhs);
+        case Token::Op_gte:   return makeBool(lhs >= rhs);
+        case Token::Op_lt:    return makeBool(lhs < rhs);
+        case Token::Op_lte:   return makeBool(lhs <= rhs);
+        case Token::Op_add:   return makeInt(wrap(ulhs + urhs));
+        case Token::Op_minus: return makeInt(wrap(ulhs - urhs));
+        case Token::Op_mult:  return makeInt(wrap(ulhs * urhs));
+        case Token::Op_divide:
+        case Token::Op_mod:
+            // left to trap at runtime
+            if (rhs == 0 || (lhs == min && rhs == -1))
+                return nullptr;
+            return makeInt(op == Token::Op_divide ? lhs / rhs : lhs % rhs);
+        case Token::Op_exp: {
+            // the exponent is read as unsigned, see CodegenVisitor::CreatePow
+            uint64_t exp = _width >= 64 ? urhs : urhs & ((uint64_t(1) << _width) - 1);
+            uint64_t res = 1;
+            for (uint64_t square = ulhs; exp; exp >>= 1, square *= square) {
+                if (exp & 1)
+                    res *= square;
+            }
+            return makeInt(wrap(res));
+        }
+        default:
+            return nullptr;
+    }
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::StmtBlockStmt *stmtBlock)
+{
+    auto& stmts = stmtBlock->stmt_list;
+    size_t numKept = 0;
+    for (size_t i = 0; i < stmts.size(); i++)
+    {
+        _stmt = stmts[i];
+        stmts[i]->accept(this);
+        if (!_stmt) {
+            _numRemoved++;
+            continue;
+        }
+        stmts[numKept++] = _stmt;
+        if (endsBlock(_stmt)) {
+            _numRemoved += stmts.size() - i - 1;
+            break;
+        }
+    }
+    stmts = ArenaArray<AST::BaseStmt*>(stmts.begin(), numKept);
+    _stmt = stmtBlock;
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::VarDeclStmt *stmt)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::ArrayDeclStmt *stmt)
+{
+    for (auto& var : stmt->decls)
+        var.expr = fold(var.expr);
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::PrintStmt *stmt)
+{
+    for (auto& arg : stmt->args)
+        arg = fold(arg);
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::IfStmt *stmt)
+{
+    stmt->cond = fold(stmt->cond);
+    stmt->trueStmt->accept(this);
+    if (stmt->falseStmt)
+        stmt->falseStmt->accept(this);
+
+    // the branch taken stays a block of its own, for the scope of what it declares
+    bool cond;
+    if (isBoolConst(stmt->cond, cond))
+        _stmt = cond ? stmt->trueStmt : stmt->falseStmt;
+    else
+        _stmt = stmt;
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::WhileStmt *stmt)
+{
+    stmt->cond = fold(stmt->cond);
+    stmt->body->accept(this);
+
+    bool cond;
+    if (isBoolConst(stmt->cond, cond) && !cond)
+        _stmt = nullptr;
+    else
+        _stmt = stmt;
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::ForStmt *stmt)
+{
+    stmt->body->accept(this);
+    _stmt = stmt;
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::ReturnStmt *stmt)
+{
+    if (stmt->returnExpr)
+        stmt->returnExpr = fold(stmt->returnExpr);
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::AbortStmt *stmt)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::ArrayAssignment *stmt)
+{
+    stmt->idxExpr = fold(stmt->idxExpr);
+    stmt->expr = fold(stmt->expr);
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::VarAssignment *stmt)
+{
+    stmt->expr = fold(stmt->expr);
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::BaseExpr* expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::TrueExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::FalseExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::NumExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::IdExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::LiteralExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::StringLiteralExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::TernaryExpr* expr)
+{
+    expr->condExpr = fold(expr->condExpr);
+    expr->trueExpr = fold(expr->trueExpr);
+    expr->falseExpr = fold(expr->falseExpr);
+
+    // only the arm picked is evaluated anyway
+    bool cond;
+    if (isBoolConst(expr->condExpr, cond)) {
+        _expr = cond ? expr->trueExpr : expr->falseExpr;
+        _numFolded++;
+    } else {
+        _expr = expr;
+    }
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::BinopExpr* expr)
+{
+    expr->leftExpr = fold(expr->leftExpr);
+    expr->rightExpr = fold(expr->rightExpr);
+    _expr = expr;
+
+    AST::BaseExpr* folded = nullptr;
+    int64_t lhsInt, rhsInt;
+    bool lhsBool, rhsBool;
+    const Token op = expr->op;
+    if (isIntConst(expr->leftExpr, lhsInt) && isIntConst(expr->rightExpr, rhsInt)) {
+        folded = foldInts(op, lhsInt, rhsInt);
+    } else if (isBoolConst(expr->leftExpr, lhsBool) && isBoolConst(expr->rightExpr, rhsBool)) {
+        if (op == Token::Op_and)
+            folded = makeBool(lhsBool && rhsBool);
+        else if (op == Token::Op_or)
+            folded = makeBool(lhsBool || rhsBool);
+        else if (op == Token::Op_eqeq)
+            folded = makeBool(lhsBool == rhsBool);
+        else if (op == Token::Op_neq)
+            folded = makeBool(lhsBool != rhsBool);
+    } else if (op == Token::Op_and || op == Token::Op_or) {
+        // one side is enough to decide, as long as the other one has nothing
+        // to evaluate for; with --short-circuit a right side after a deciding
+        // left one isn't evaluated at all
+        const bool decides = op == Token::Op_or;
+        bool shortCircuit = Lilang::Settings::get().isOn("short-circuit");
+        if (isBoolConst(expr->leftExpr, lhsBool)) {
+            if (lhsBool != decides)
+                folded = expr->rightExpr;
+            else if (shortCircuit || isPure(expr->rightExpr))
+                folded = expr->leftExpr;
+        } else if (isBoolConst(expr->rightExpr, rhsBool)) {
+            if (rhsBool != decides)
+                folded = expr->leftExpr;
+            else if (isPure(expr->leftExpr))
+                folded = expr->rightExpr;
+        }
+    }
+
+    if (folded) {
+        _expr = folded;
+        _numFolded++;
+    }
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::UnaryExpr *expr)
+{
+    expr->expr = fold(expr->expr);
+    _expr = expr;
+
+    AST::BaseExpr* folded = nullptr;
+    int64_t intVal;
+    bool boolVal;
+    if (expr->type == Token::Op_minus && isIntConst(expr->expr, intVal))
+        folded = makeInt(wrap(0 - static_cast<uint64_t>(wrap(intVal))));
+    else if (expr->type == Token::Op_bang && isBoolConst(expr->expr, boolVal))
+        folded = makeBool(!boolVal);
+
+    if (folded) {
+        _expr = folded;
+        _numFolded++;
+    }
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::SizeofExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::InputExpr *expr)
+{
+
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::ArrayExpr *expr)
+{
+    expr->expr = fold(expr->expr);
+    _expr = expr;
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::FnCallExpr *expr)
+{
+    for (auto& arg : expr->fnArgs)
+        arg = fold(arg);
+    _expr = expr;
+}
+
+void Visitor::ConstantFoldVisitor::visit(AST::Program* program)
+{
+    _arena = &program->arena;
+    _width = Lilang::Settings::get().getWidth();
+    for (auto& fnDef : program->fnDefinitions)
+        fnDef->body->accept(this);
+}
+
+void Visitor::ConstantFoldVisitor::printStats(std::ostream& out) const
+{
+    out << "Constant folding:" << std::endl;
+    out << "\tfolded\t" << _numFolded << std::endl;
+    out << "\tremoved\t" << _numRemoved << std::endl;
+}
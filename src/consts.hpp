@@ -192,7 +192,7 @@ inline bool isEqOrNeq(Token op) {
 
 extern int yylineno;
 extern char* yytext;
-extern std::string tokenVal;
 
 int yylex();
-void yyrestart(FILE* fp);
+size_t yytextlen();
+void yyscanbuffer(char* base, size_t size);
@@ -0,0 +1,323 @@
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "lexer.hpp"
+
+namespace {
+    enum class CharClass : uint8_t {
+        Other,      // ignored, like flex's catch-all rule
+        Blank,      // [ \t\r]
+        Newline,
+        Alpha,      // [a-zA-Z_]
+        Digit,
+        Punct,      // single character tokens
+        Minus,      // - or a negative number
+        Colon,      // : or :=
+        Bang,       // ! or !=
+        Equal,      // ==
+        Greater,    // > or >=
+        Less,       // < or <=
+        Quote,
+        Semicolon,  // comment till the end of the line
+        Backslash   // line continuation
+    };
+
+    struct ByteTables {
+        CharClass charClass[256];
+        Token punct[256];
+
+        ByteTables() {
+            for (int c = 0; c < 256; c++) {
+                charClass[c] = CharClass::Other;
+                punct[c] = Token::Err;
+            }
+            for (int c = 'a'; c <= 'z'; c++)
+                charClass[c] = CharClass::Alpha;
+            for (int c = 'A'; c <= 'Z'; c++)
+                charClass[c] = CharClass::Alpha;
+            charClass['_'] = CharClass::Alpha;
+            for (int c = '0'; c <= '9'; c++)
+                charClass[c] = CharClass::Digit;
+
+            charClass[' '] = CharClass::Blank;
+            charClass['\t'] = CharClass::Blank;
+            charClass['\r'] = CharClass::Blank;
+            charClass['\n'] = CharClass::Newline;
+            charClass['-'] = CharClass::Minus;
+            charClass[':'] = CharClass::Colon;
+            charClass['!'] = CharClass::Bang;
+            charClass['='] = CharClass::Equal;
+            charClass['>'] = CharClass::Greater;
+            charClass['<'] = CharClass::Less;
+            charClass['"'] = CharClass::Quote;
+            charClass[';'] = CharClass::Semicolon;
+            charClass['\\'] = CharClass::Backslash;
+
+            const std::pair<unsigned char, Token> singles[] = {
+                {'(', Token::PL}, {')', Token::PR},
+                {'[', Token::SL}, {']', Token::SR},
+                {'{', Token::CL}, {'}', Token::CR},
+                {'+', Token::Op_add}, {'*', Token::Op_mult},
+                {'^', Token::Op_exp}, {'/', Token::Op_divide},
+                {'%', Token::Op_mod}, {'&', Token::Op_and},
+                {'|', Token::Op_or}, {'?', Token::Op_question},
+                {',', Token::Comma}
+            };
+            for (auto& single : singles) {
+                charClass[single.first] = CharClass::Punct;
+                punct[single.first] = single.second;
+            }
+        }
+    };
+
+    const ByteTables tables;
+
+    inline CharClass classOf(char c) {
+        return tables.charClass[static_cast<unsigned char>(c)];
+    }
+
+    inline bool isIdentChar(char c) {
+        CharClass cls = classOf(c);
+        return cls == CharClass::Alpha || cls == CharClass::Digit;
+    }
+
+    struct Keyword {
+        const char* str;
+        size_t len;
+        Token type;
+    };
+
+    // slot = (first char + 6 * last char + length) % 32, which has no collisions for our keywords
+    const Keyword keywordTable[32] = {
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {"int",     3, Token::Type_int},
+        {nullptr,   0, Token::Id},
+        {"input",   5, Token::Input},
+        {"else",    4, Token::Else},
+        {nullptr,   0, Token::Id},
+        {"false",   5, Token::Literal_false},
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {"return",  6, Token::Return},
+        {"print",   5, Token::Print},
+        {"bool",    4, Token::Type_bool},
+        {"if",      2, Token::If},
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {"void",    4, Token::Type_void},
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {"for",     3, Token::For},
+        {"true",    4, Token::Literal_true},
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {nullptr,   0, Token::Id},
+        {"while",   5, Token::While},
+        {nullptr,   0, Token::Id},
+        {"array",   5, Token::Type_array},
+        {"sizeof",  6, Token::Sizeof},
+        {"abort",   5, Token::Abort},
+        {nullptr,   0, Token::Id},
+    };
+}
+
+const char* FastLexer::skipBlanks(const char* p) const
+{
+    if (p >= _end || classOf(*p) != CharClass::Blank)
+        return p;
+
+#ifdef __SSE2__
+    // never load past _end; the mapping may stop right after the trailing NULs
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    while (_end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                                  _mm_cmpeq_epi8(chunk, tab)),
+                                     _mm_cmpeq_epi8(chunk, cr));
+        unsigned nonBlank = ~static_cast<unsigned>(_mm_movemask_epi8(blank)) & 0xffff;
+        if (nonBlank)
+            return p + __builtin_ctz(nonBlank);
+        p += 16;
+    }
+#endif
+
+    while (p < _end && classOf(*p) == CharClass::Blank)
+        p++;
+    return p;
+}
+
+Token FastLexer::keyword(const char* str, size_t len) const
+{
+    size_t slot = (static_cast<unsigned char>(str[0]) +
+                   6 * static_cast<unsigned char>(str[len - 1]) + len) & 31;
+    const Keyword& kw = keywordTable[slot];
+    if (kw.len == len && memcmp(kw.str, str, len) == 0)
+        return kw.type;
+    return Token::Id;
+}
+
+void FastLexer::next(TokenInfo& tok)
+{
+    // The source is followed by NUL bytes, so looking one character past a
+    // token is always safe and never matches anything.
+    const char* p = _cur;
+    const char* start = p;
+    Token type = Token::End;
+    for (;;) {
+        p = skipBlanks(p);
+        start = p;
+        if (p >= _end) {
+            type = Token::End;
+            break;
+        }
+
+        switch (classOf(*p)) {
+            case CharClass::Newline:
+                p++;
+                _lineno++;
+                type = Token::EOL;
+                break;
+            case CharClass::Alpha:
+                while (isIdentChar(*++p));
+                type = keyword(start, p - start);
+                break;
+            case CharClass::Digit:
+                while (classOf(*++p) == CharClass::Digit);
+                type = Token::Number;
+                break;
+            case CharClass::Minus:
+                type = Token::Op_minus;
+                if (classOf(*++p) == CharClass::Digit) {
+                    while (classOf(*++p) == CharClass::Digit);
+                    type = Token::Number;
+                }
+                break;
+            case CharClass::Punct:
+                type = tables.punct[static_cast<unsigned char>(*p++)];
+                break;
+            case CharClass::Colon:
+                type = *++p == '=' ? (p++, Token::Op_assignment) : Token::Op_colon;
+                break;
+            case CharClass::Bang:
+                type = *++p == '=' ? (p++, Token::Op_neq) : Token::Op_bang;
+                break;
+            case CharClass::Greater:
+                type = *++p == '=' ? (p++, Token::Op_gte) : Token::Op_gt;
+                break;
+            case CharClass::Less:
+                type = *++p == '=' ? (p++, Token::Op_lte) : Token::Op_lt;
+                break;
+            case CharClass::Equal:
+                if (p[1] == '=') {
+                    p += 2;
+                    type = Token::Op_eqeq;
+                    break;
+                }
+                p++; // a single '=' is not a token
+                continue;
+            case CharClass::Quote:
+            {
+                // "(\\.|[^\\"])*" -- an escape can't be followed by a newline
+                const char* q = p + 1;
+                int newlines = 0;
+                while (q < _end && *q != '"') {
+                    if (*q == '\\') {
+                        if (q + 1 >= _end || q[1] == '\n')
+                            break;
+                        q++;
+                    } else if (*q == '\n') {
+                        newlines++;
+                    }
+                    q++;
+                }
+                if (q < _end && *q == '"') {
+                    p = q + 1;
+                    _lineno += newlines;
+                    type = Token::Literal_string;
+                    break;
+                }
+                p++; // no closing quote, so the quote is skipped like any stray character
+                continue;
+            }
+            case CharClass::Semicolon:
+            {
+                // memchr is vectorized in any decent libc
+                const void* eol = memchr(p, '\n', _end - p);
+                p = eol ? static_cast<const char*>(eol) : _end;
+                continue;
+            }
+            case CharClass::Backslash:
+                if (p[1] == '\n') {
+                    p += 2;
+                    _lineno++;
+                } else {
+                    p++;
+                }
+                continue;
+            default:
+                p++;
+                continue;
+        }
+        break;
+    }
+
+    _cur = p;
+    tok.type = type;
+    tok.lineno = _lineno;
+    tok.text.offset = static_cast<uint32_t>(start - _source);
+    tok.text.length = static_cast<uint32_t>(p - start);
+}
+
+static void lexAll(Lexer& lexer, std::vector<TokenInfo>& toks)
+{
+    TokenInfo tok;
+    do {
+        lexer.next(tok);
+        toks.push_back(tok);
+    } while (tok.type != Token::End);
+}
+
+bool checkLexers(SourceFile& src, std::ostream& err)
+{
+    // flex writes into the buffer while it scans, so the fast lexer goes first
+    std::vector<TokenInfo> fastToks, flexToks;
+    FastLexer fastLexer(src);
+    lexAll(fastLexer, fastToks);
+    FlexScanner flexScanner(src);
+    lexAll(flexScanner, flexToks);
+
+    auto describe = [&src](const TokenInfo& tok) {
+        return std::to_string(static_cast<int>(tok.type)) + " '" +
+               std::string(src.data() + tok.text.offset, tok.text.length) +
+               "' at line " + std::to_string(tok.lineno);
+    };
+
+    for (size_t i = 0; i < fastToks.size() && i < flexToks.size(); i++) {
+        const TokenInfo& a = flexToks[i];
+        const TokenInfo& b = fastToks[i];
+        bool same = a.type == b.type && a.lineno == b.lineno;
+        if (same && a.type != Token::End)
+            same = a.text.offset == b.text.offset && a.text.length == b.text.length;
+        if (!same) {
+            err << "lexer mismatch at token " << i << ": flex " << describe(a)
+                << ", fast " << describe(b) << std::endl;
+            return false;
+        }
+    }
+
+    if (fastToks.size() != flexToks.size()) {
+        err << "lexer mismatch: flex produced " << flexToks.size()
+            << " tokens, fast " << fastToks.size() << std::endl;
+        return false;
+    }
+    return true;
+}
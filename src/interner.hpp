@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// interned string; ids are dense and handed out from 0 in order of first use
+typedef uint32_t Symbol;
+
+// Identifiers and string literals are interned once by the parser, the rest of
+// the compiler passes around and compares Symbols instead of strings.
+class Interner {
+    std::unordered_map<std::string, Symbol> _ids;
+    // points to the keys of `_ids', which never move
+    std::vector<const std::string*> _names;
+
+    public:
+    Symbol intern(const std::string& str) {
+        auto res = _ids.emplace(str, static_cast<Symbol>(_names.size()));
+        if (res.second)
+            _names.push_back(&res.first->first);
+        return res.first->second;
+    }
+
+    Symbol intern(const char* str, size_t len) {
+        return intern(std::string(str, len));
+    }
+
+    const std::string& name(Symbol sym) const {
+        return *_names[sym];
+    }
+
+    size_t size() const { return _names.size(); }
+
+    static Interner& get() {
+        static Interner InternerInstance;
+        return InternerInstance;
+    }
+};
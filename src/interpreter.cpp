@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "baseast.hpp"
+#include "visitor.hpp"
+#include "utils.hpp"
+#include "backend.hpp"
+#include "interpreter.hpp"
+
+extern "C" {
+    // runtime.c
+    int64_t __l_input();
+    void __l_print_int(int64_t x);
+    void __l_print_string(char* str);
+    void __l_abort();
+    void __l_flush();
+    uint64_t __l_pow(uint64_t x, uint64_t n);
+}
+
+using Bytecode::Op;
+
+namespace {
+    // registers, 64MB; only the part that's used gets touched
+    constexpr size_t StackSlots = size_t(1) << 23;
+
+    Bytecode::Array emptyArray = {0, nullptr};
+
+    // native code traps on these in the division instruction
+    [[noreturn]] void divisionTrap()
+    {
+        __l_flush();
+        std::raise(SIGFPE);
+        std::abort();
+    }
+
+    bool divisionTraps(int64_t lhs, int64_t rhs)
+    {
+        return rhs == 0 || (rhs == -1 && lhs == std::numeric_limits<int64_t>::min());
+    }
+
+    Bytecode::Array* toArray(int64_t reg)
+    {
+        return reinterpret_cast<Bytecode::Array*>(reg);
+    }
+}
+
+Lilang::Interpreter::Interpreter(Bytecode::Module& module, AST::Program& program,
+                                 uint32_t jitThreshold, unsigned optLevel)
+    : _module(module),
+      _program(program),
+      _jitThreshold(jitThreshold),
+      _optLevel(optLevel),
+      _stack(new int64_t[StackSlots]),
+      _stackEnd(_stack.get() + StackSlots),
+      _top(_stack.get())
+{
+}
+
+int64_t Lilang::Interpreter::run()
+{
+    Bytecode::Function& mainFn = _module.functions[_module.mainIdx];
+    std::vector<int64_t> args;
+    for (auto& param : mainFn.def->proto->fnParams)
+        args.push_back(param.type == Token::Type_array ? reinterpret_cast<int64_t>(&emptyArray) : 0);
+    return call(mainFn, args.data());
+}
+
+int64_t Lilang::Interpreter::call(Bytecode::Function& fn, const int64_t* args)
+{
+    if (!fn.compiled && fn.canCompile && _jitThreshold && ++fn.hotness >= _jitThreshold)
+        compile(fn);
+    if (fn.native)
+        return fn.native(args);
+
+    int64_t* regs = _top;
+    if (static_cast<size_t>(_stackEnd - regs) < fn.numRegs)
+        throw Exception("interpreter stack overflow");
+    std::copy(args, args + fn.numParams, regs);
+    _top = regs + fn.numRegs;
+    int64_t result = execute(fn, regs);
+    // also releases the arrays the function declared
+    _top = regs;
+    return result;
+}
+
+// With computed goto every instruction holds the address of its handler and
+// each handler jumps straight to the next one (direct threading). Otherwise
+// it's a loop around a switch.
+#if defined(__GNUC__)
+#define LILANG_THREADED 1
+#define CASE(name) op_##name:
+#define NEXT() do { in = ip++; goto *in->handler; } while (0)
+#else
+#define CASE(name) case Op::name:
+#define NEXT() continue
+#endif
+
+int64_t Lilang::Interpreter::execute(Bytecode::Function& fn, int64_t* regs)
+{
+#ifdef LILANG_THREADED
+    static const void* const handlers[] = {
+        &&op_Move, &&op_LoadInt, &&op_EmptyArray,
+        &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Mod, &&op_Pow, &&op_And, &&op_Or,
+        &&op_Eq, &&op_Ne, &&op_Lt, &&op_Le, &&op_Gt, &&op_Ge,
+        &&op_AddImm,
+        &&op_Not, &&op_Neg,
+        &&op_Jump, &&op_JumpIfFalse, &&op_Loop,
+        &&op_JumpEq, &&op_JumpNe, &&op_JumpLt, &&op_JumpLe, &&op_JumpGt, &&op_JumpGe,
+        &&op_Call,
+        &&op_Ret, &&op_RetVoid,
+        &&op_PrintInt, &&op_PrintString, &&op_Input, &&op_Abort,
+        &&op_NewArray, &&op_Load, &&op_Store, &&op_Size,
+        &&op_StackSave, &&op_StackRestore,
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<size_t>(Op::NumOps),
+                  "every op needs a handler");
+
+    if (fn.threaded.empty()) {
+        fn.threaded.reserve(fn.code.size());
+        for (auto& instr : fn.code)
+            fn.threaded.push_back({handlers[static_cast<size_t>(instr.op)], instr.a, instr.b, instr.c});
+    }
+    const Bytecode::ThreadedInstr* code = fn.threaded.data();
+    const Bytecode::ThreadedInstr* ip = code;
+    const Bytecode::ThreadedInstr* in;
+    NEXT();
+#else
+    const Bytecode::Instr* code = fn.code.data();
+    const Bytecode::Instr* ip = code;
+    const Bytecode::Instr* in;
+    for (;;) {
+        in = ip++;
+        switch (in->op) {
+#endif
+            CASE(Move)
+                regs[in->a] = regs[in->b];
+                NEXT();
+            CASE(LoadInt)
+                regs[in->a] = in->b;
+                NEXT();
+            CASE(EmptyArray)
+                regs[in->a] = reinterpret_cast<int64_t>(&emptyArray);
+                NEXT();
+
+            // ints wrap around like in native code
+            CASE(Add)
+                regs[in->a] = static_cast<int64_t>(static_cast<uint64_t>(regs[in->b]) + static_cast<uint64_t>(regs[in->c]));
+                NEXT();
+            CASE(Sub)
+                regs[in->a] = static_cast<int64_t>(static_cast<uint64_t>(regs[in->b]) - static_cast<uint64_t>(regs[in->c]));
+                NEXT();
+            CASE(Mul)
+                regs[in->a] = static_cast<int64_t>(static_cast<uint64_t>(regs[in->b]) * static_cast<uint64_t>(regs[in->c]));
+                NEXT();
+            CASE(Div)
+                if (divisionTraps(regs[in->b], regs[in->c]))
+                    divisionTrap();
+                regs[in->a] = regs[in->b] / regs[in->c];
+                NEXT();
+            CASE(Mod)
+                if (divisionTraps(regs[in->b], regs[in->c]))
+                    divisionTrap();
+                regs[in->a] = regs[in->b] % regs[in->c];
+                NEXT();
+            CASE(Pow)
+                regs[in->a] = static_cast<int64_t>(__l_pow(regs[in->b], regs[in->c]));
+                NEXT();
+            CASE(And)
+                regs[in->a] = regs[in->b] & regs[in->c];
+                NEXT();
+            CASE(Or)
+                regs[in->a] = regs[in->b] | regs[in->c];
+                NEXT();
+            CASE(Eq)
+                regs[in->a] = regs[in->b] == regs[in->c];
+                NEXT();
+            CASE(Ne)
+                regs[in->a] = regs[in->b] != regs[in->c];
+                NEXT();
+            CASE(Lt)
+                regs[in->a] = regs[in->b] < regs[in->c];
+                NEXT();
+            CASE(Le)
+                regs[in->a] = regs[in->b] <= regs[in->c];
+                NEXT();
+            CASE(Gt)
+                regs[in->a] = regs[in->b] > regs[in->c];
+                NEXT();
+            CASE(Ge)
+                regs[in->a] = regs[in->b] >= regs[in->c];
+                NEXT();
+            CASE(AddImm)
+                regs[in->a] = static_cast<int64_t>(static_cast<uint64_t>(regs[in->b]) + static_cast<uint64_t>(in->c));
+                NEXT();
+            CASE(Not)
+                regs[in->a] = regs[in->b] ^ 1;
+                NEXT();
+            CASE(Neg)
+                regs[in->a] = static_cast<int64_t>(0 - static_cast<uint64_t>(regs[in->b]));
+                NEXT();
+
+            CASE(Jump)
+                ip = code + in->a;
+                NEXT();
+            CASE(JumpIfFalse)
+                if (!regs[in->a])
+                    ip = code + in->b;
+                NEXT();
+            CASE(Loop)
+                // only looked at on the next call: this one can't move to native code
+                fn.hotness++;
+                ip = code + in->a;
+                NEXT();
+            CASE(JumpEq)
+                if (regs[in->a] == regs[in->b])
+                    ip = code + in->c;
+                NEXT();
+            CASE(JumpNe)
+                if (regs[in->a] != regs[in->b])
+                    ip = code + in->c;
+                NEXT();
+            CASE(JumpLt)
+                if (regs[in->a] < regs[in->b])
+                    ip = code + in->c;
+                NEXT();
+            CASE(JumpLe)
+                if (regs[in->a] <= regs[in->b])
+                    ip = code + in->c;
+                NEXT();
+            CASE(JumpGt)
+                if (regs[in->a] > regs[in->b])
+                    ip = code + in->c;
+                NEXT();
+            CASE(JumpGe)
+                if (regs[in->a] >= regs[in->b])
+                    ip = code + in->c;
+                NEXT();
+
+            CASE(Call)
+                regs[in->a] = call(_module.functions[in->b], regs + in->c);
+                NEXT();
+            CASE(Ret)
+                return regs[in->a];
+            CASE(RetVoid)
+                return 0;
+
+            CASE(PrintInt)
+                __l_print_int(regs[in->a]);
+                NEXT();
+            CASE(PrintString)
+                __l_print_string(const_cast<char*>(_module.strings[in->a]));
+                NEXT();
+            CASE(Input)
+                regs[in->a] = __l_input();
+                NEXT();
+            CASE(Abort)
+                __l_abort();
+                NEXT();
+
+            CASE(NewArray) {
+                int64_t size = regs[in->b];
+                if (size < 0)
+                    __l_abort();
+                // the header and then the elements, like an alloca of both
+                if (static_cast<size_t>(_stackEnd - _top) < static_cast<size_t>(size) + 2)
+                    throw Exception("interpreter stack overflow");
+                Bytecode::Array* array = reinterpret_cast<Bytecode::Array*>(_top);
+                array->size = size;
+                array->data = _top + 2;
+                std::fill(array->data, array->data + size, 0);
+                _top += size + 2;
+                regs[in->a] = reinterpret_cast<int64_t>(array);
+                NEXT();
+            }
+            CASE(Load) {
+                Bytecode::Array* array = toArray(regs[in->b]);
+                uint64_t idx = static_cast<uint64_t>(regs[in->c]);
+                if (idx >= static_cast<uint64_t>(array->size))
+                    __l_abort();
+                regs[in->a] = array->data[idx];
+                NEXT();
+            }
+            CASE(Store) {
+                Bytecode::Array* array = toArray(regs[in->a]);
+                uint64_t idx = static_cast<uint64_t>(regs[in->b]);
+                if (idx >= static_cast<uint64_t>(array->size))
+                    __l_abort();
+                array->data[idx] = regs[in->c];
+                NEXT();
+            }
+            CASE(Size)
+                regs[in->a] = toArray(regs[in->b])->size;
+                NEXT();
+            CASE(StackSave)
+                regs[in->a] = reinterpret_cast<int64_t>(_top);
+                NEXT();
+            CASE(StackRestore)
+                _top = reinterpret_cast<int64_t*>(regs[in->a]);
+                NEXT();
+#ifndef LILANG_THREADED
+            case Op::NumOps:
+                break;
+        }
+    }
+#endif
+}
+
+#undef CASE
+#undef NEXT
+
+void Lilang::Interpreter::compile(Bytecode::Function& fn)
+{
+    if (!_jit) {
+        std::string err;
+        std::unique_ptr<llvm::TargetMachine> tm = createHostTargetMachine(_optLevel, err);
+        if (!tm) {
+            std::cerr << "warning: interpreting without the JIT: " << err << std::endl;
+            _jitThreshold = 0;
+            return;
+        }
+        _jit = llvm::make_unique<JIT>(std::move(tm));
+    }
+
+    // native code can't call back into the interpreter, so whatever `fn' may
+    // call is compiled along with it
+    std::vector<Bytecode::Function*> fns;
+    std::vector<AST::FunctionDefinition*> fnDefs;
+    std::vector<bool> seen(_module.functions.size());
+    std::vector<unsigned> pending = {static_cast<unsigned>(&fn - _module.functions.data())};
+    while (!pending.empty()) {
+        unsigned idx = pending.back();
+        pending.pop_back();
+        Bytecode::Function& callee = _module.functions[idx];
+        if (seen[idx] || callee.compiled)
+            continue;
+        seen[idx] = true;
+        fns.push_back(&callee);
+        fnDefs.push_back(callee.def);
+        pending.insert(pending.end(), callee.callees.begin(), callee.callees.end());
+    }
+
+    try {
+        Visitor::CodegenVisitor::createModule("lilang.jit" + std::to_string(++_numCompiles));
+        llvm::Module& module = *Visitor::CodegenVisitor::getModule();
+        configureModule(module, _jit->getTargetMachine());
+        Visitor::CodegenVisitor codegenVisitor;
+        codegenVisitor.generate(&_program, fnDefs);
+        std::vector<std::string> entryPoints(fns.size());
+        for (size_t i = 0; i < fns.size(); i++) {
+            if (fns[i]->canCompile)
+                entryPoints[i] = codegenVisitor.generateEntryPoint(fns[i]->def);
+        }
+        optimizeModule(module, &_jit->getTargetMachine(), _optLevel);
+        _jit->addModule(Visitor::CodegenVisitor::releaseModule());
+
+        for (size_t i = 0; i < fns.size(); i++) {
+            fns[i]->compiled = true;
+            if (!entryPoints[i].empty())
+                fns[i]->native = reinterpret_cast<Bytecode::NativeEntry>(_jit->getFunctionAddress(entryPoints[i]));
+        }
+    } catch (Exception& exc) {
+        // they keep running in the interpreter
+        for (auto& compiledFn : fns)
+            compiledFn->canCompile = false;
+    }
+
+    if (Settings::get().isOn("stats")) {
+        std::cout << "  JIT compiled " << Interner::get().name(fn.def->proto->fnName)
+                  << (fn.native ? "" : " (failed)") << " after " << fn.hotness
+                  << " calls and back-edges" << std::endl;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "bytecode.hpp"
+#include "jit.hpp"
+
+namespace AST {
+    class Program;
+}
+
+namespace Lilang {
+    // Runs the bytecode of a program. Calls and loop back-edges are counted per
+    // function, and a function that gets hot is JIT compiled through codegen and
+    // called natively from its next call on; a call already running stays in the
+    // interpreter, so a hot loop in main or in a function called once never
+    // gets compiled.
+    class Interpreter {
+        Bytecode::Module& _module;
+        AST::Program& _program;
+        // hotness at which functions are compiled, 0 to never compile
+        uint32_t _jitThreshold;
+        unsigned _optLevel;
+        std::unique_ptr<JIT> _jit;
+        unsigned _numCompiles = 0;
+
+        // registers of the running functions and the arrays they declared
+        std::unique_ptr<int64_t[]> _stack;
+        int64_t* _stackEnd;
+        int64_t* _top;
+
+        int64_t call(Bytecode::Function& fn, const int64_t* args);
+        int64_t execute(Bytecode::Function& fn, int64_t* regs);
+        void compile(Bytecode::Function& fn);
+
+        public:
+        Interpreter(Bytecode::Module& module, AST::Program& program,
+                    uint32_t jitThreshold, unsigned optLevel);
+
+        // calls main, with zeroes and empty arrays for any parameters it has;
+        // returns what main returns
+        int64_t run();
+    };
+}
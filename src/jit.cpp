@@ -0,0 +1,103 @@
+#include <llvm/ExecutionEngine/Orc/Legacy.h>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "consts.hpp"
+#include "jit.hpp"
+
+extern "C" {
+    // runtime.c
+    int64_t __l_input();
+    void __l_print(const char* kinds, ...);
+    void __l_abort();
+    void __l_out_of_bounds(int64_t line);
+    void* __l_arena_alloc(int64_t count, int64_t elem_size);
+    void* __l_arena_mark();
+    void __l_arena_release(void* mark);
+}
+
+namespace {
+    struct RuntimeSymbol {
+        const char* name;
+        void* address;
+    };
+
+    const RuntimeSymbol runtimeSymbols[] = {
+        {"__l_input",        reinterpret_cast<void*>(&__l_input)},
+        {"__l_print",        reinterpret_cast<void*>(&__l_print)},
+        {"__l_abort",        reinterpret_cast<void*>(&__l_abort)},
+        {"__l_out_of_bounds", reinterpret_cast<void*>(&__l_out_of_bounds)},
+        {"__l_arena_alloc",  reinterpret_cast<void*>(&__l_arena_alloc)},
+        {"__l_arena_mark",   reinterpret_cast<void*>(&__l_arena_mark)},
+        {"__l_arena_release", reinterpret_cast<void*>(&__l_arena_release)},
+    };
+}
+
+Lilang::JIT::JIT(std::unique_ptr<llvm::TargetMachine> tm)
+    : _resolver(llvm::orc::createLegacyLookupResolver(
+          _session,
+          [this](const std::string& name) { return findMangledSymbol(name); },
+          [](llvm::Error err) { llvm::cantFail(std::move(err), "lookupFlags failed"); })),
+      _tm(std::move(tm)),
+      _dl(_tm->createDataLayout()),
+      _objectLayer(_session,
+                   [this](llvm::orc::VModuleKey) {
+                       return ObjectLayer::Resources{
+                           std::make_shared<llvm::SectionMemoryManager>(), _resolver};
+                   }),
+      _compileLayer(_objectLayer, llvm::orc::SimpleCompiler(*_tm))
+{
+    // anything else, like memset, comes from the libraries lilang is linked with
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+}
+
+std::string Lilang::JIT::mangle(const std::string& name)
+{
+    std::string mangledName;
+    llvm::raw_string_ostream mangledNameStream(mangledName);
+    llvm::Mangler::getNameWithPrefix(mangledNameStream, name, _dl);
+    return mangledNameStream.str();
+}
+
+llvm::JITSymbol Lilang::JIT::findMangledSymbol(const std::string& name)
+{
+    if (auto sym = _compileLayer.findSymbol(name, false))
+        return sym;
+    else if (auto err = sym.takeError())
+        return std::move(err);
+
+    for (auto& runtimeSym : runtimeSymbols) {
+        if (mangle(runtimeSym.name) == name)
+            return llvm::JITSymbol(reinterpret_cast<uint64_t>(runtimeSym.address),
+                                   llvm::JITSymbolFlags::Exported);
+    }
+
+    if (uint64_t addr = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name))
+        return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
+    return nullptr;
+}
+
+void Lilang::JIT::addModule(std::unique_ptr<llvm::Module> module)
+{
+    llvm::orc::VModuleKey key = _session.allocateVModule();
+    if (auto err = _compileLayer.addModule(key, std::move(module)))
+        throw Exception("JIT: " + llvm::toString(std::move(err)));
+}
+
+uint64_t Lilang::JIT::getFunctionAddress(const std::string& name)
+{
+    llvm::JITSymbol sym = findMangledSymbol(mangle(name));
+    if (!sym) {
+        if (auto err = sym.takeError())
+            throw Exception("JIT: " + llvm::toString(std::move(err)));
+        return 0;
+    }
+
+    auto addr = sym.getAddress();
+    if (!addr)
+        throw Exception("JIT: " + llvm::toString(addr.takeError()));
+    return *addr;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <llvm/ExecutionEngine/JITSymbol.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/Core.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+namespace Lilang {
+    // Compiles modules to machine code in memory so that they can be run inside
+    // the lilang process. The runtime (runtime.c) is linked into lilang and its
+    // functions are bound directly, so compiled code calls them like any other.
+    class JIT {
+        using ObjectLayer = llvm::orc::RTDyldObjectLinkingLayer;
+        using CompileLayer = llvm::orc::IRCompileLayer<ObjectLayer, llvm::orc::SimpleCompiler>;
+
+        llvm::orc::ExecutionSession _session;
+        std::shared_ptr<llvm::orc::SymbolResolver> _resolver;
+        std::unique_ptr<llvm::TargetMachine> _tm;
+        const llvm::DataLayout _dl;
+        ObjectLayer _objectLayer;
+        CompileLayer _compileLayer;
+
+        std::string mangle(const std::string& name);
+        llvm::JITSymbol findMangledSymbol(const std::string& name);
+
+        public:
+        explicit JIT(std::unique_ptr<llvm::TargetMachine> tm);
+
+        llvm::TargetMachine& getTargetMachine() { return *_tm; }
+
+        // `module' should have been generated for the target machine's data layout
+        void addModule(std::unique_ptr<llvm::Module> module);
+
+        // address of the compiled function `name', 0 if there's none
+        uint64_t getFunctionAddress(const std::string& name);
+    };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+#include "consts.hpp"
+#include "sourcefile.hpp"
+
+// where a token's text lives in the source buffer
+struct SourceSpan {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+struct TokenInfo {
+    int lineno;
+    Token type;
+    SourceSpan text;
+};
+
+// Produces the tokens of a source buffer one at a time. Lexers scan the
+// buffer in place and only record where a token's text is. The line number
+// of a token is the one the lexer is at after consuming it (so an EOL token
+// is already on the next line), matching flex's yylineno.
+class Lexer {
+    public:
+    virtual ~Lexer() = default;
+
+    // fills in the next token; End is returned once the input is exhausted
+    virtual void next(TokenInfo& tok) = 0;
+};
+
+// the flex scanner generated from lexer.l
+class FlexScanner : public Lexer {
+    const char* _source;
+
+    public:
+    explicit FlexScanner(SourceFile& src) : _source(src.data()) {
+        yyscanbuffer(src.data(), src.size() + 2);
+    }
+
+    void next(TokenInfo& tok) override {
+        tok.type = static_cast<Token>(yylex());
+        tok.lineno = yylineno;
+        tok.text.offset = static_cast<uint32_t>(yytext - _source);
+        tok.text.length = tok.type == Token::End ? 0 : static_cast<uint32_t>(yytextlen());
+    }
+};
+
+// Hand-written lexer for the lilang token set (--lexer=fast). Characters are
+// dispatched through a byte-class table, runs of blanks are skipped 16 bytes
+// at a time with SSE2 where available, and keywords are found with a perfect
+// hash over the identifier's first and last character and its length.
+class FastLexer : public Lexer {
+    const char* _source;
+    const char* _cur;
+    const char* _end;
+    int _lineno = 1;
+
+    const char* skipBlanks(const char* p) const;
+    Token keyword(const char* str, size_t len) const;
+
+    public:
+    explicit FastLexer(SourceFile& src)
+        : _source(src.data()), _cur(src.data()), _end(src.data() + src.size()) { }
+
+    void next(TokenInfo& tok) override;
+};
+
+// Lexes `src' with both lexers and reports the first token they disagree on
+// to `err'. Returns true if the token streams are identical.
+bool checkLexers(SourceFile& src, std::ostream& err);
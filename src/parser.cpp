@@ -4,27 +4,82 @@
 #include <set>
 #include <cstring>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
 
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
 
 #include "consts.hpp"
 #include "baseast.hpp"
 #include "visitor.hpp"
 #include "utils.hpp"
+#include "lexer.hpp"
+#include "sourcefile.hpp"
+#include "tokenstream.hpp"
+#include "backend.hpp"
+#include "jit.hpp"
+#include "interpreter.hpp"
+
+extern "C" {
+    // runtime.c
+    void __l_flush();
+}
 
-struct TokenInfo {
-    int lineno;
-    std::string token;
-    Token type;
-};
+// tokens are lexed lazily as the parser asks for them
+static TokenStream tokens;
+
+// nodes are allocated in the arena of the program being parsed
+static Arena* astArena = nullptr;
 
-// contains all the tokens
-static std::vector<TokenInfo> tokens;
+template <typename T, typename... Args>
+T* makeNode(Args&&... args)
+{
+    return astArena->make<T>(std::forward<Args>(args)...);
+}
 
 int curTok = -1;
 int curTokIdx = -1;
-std::string curVal;
+
+// expression productions, counted for --stats
+enum class Production {
+    Expr,
+    True,
+    False,
+    Number,
+    Ternary,
+    Sizeof,
+    Input,
+    Array,
+    Fncall,
+    Ident,
+    Binop,
+    Unaryop,
+    Count
+};
+
+const char* productionName(Production prod)
+{
+    switch(prod) {
+        case Production::Expr:    return "expr";
+        case Production::True:    return "true";
+        case Production::False:   return "false";
+        case Production::Number:  return "number";
+        case Production::Ternary: return "ternary";
+        case Production::Sizeof:  return "sizeof";
+        case Production::Input:   return "input";
+        case Production::Array:   return "array";
+        case Production::Fncall:  return "fncall";
+        case Production::Ident:   return "ident";
+        case Production::Binop:   return "binop";
+        case Production::Unaryop: return "unaryop";
+        default:                  return "unknown";
+    }
+}
+
+// number of times each expression production was attempted
+static unsigned parseAttempts[static_cast<int>(Production::Count)];
 
 void printHelp(const std::string& commandName)
 {
@@ -32,18 +87,56 @@ void printHelp(const std::string& commandName)
     std::cout << "OPTIONS" << std::endl;
     std::cout << "\t--print-ast\t\tPrints the AST of the parsed program" << std::endl;
     std::cout << "\t--print-ir=[FILENAME]\tPrints the LLVM IR of the program. If FILENAME is specified, it's written there instead of stdout." << std::endl;
+    std::cout << "\t--lexer=flex|fast\tLexer to tokenize the source with. By default, the flex generated one" << std::endl;
+    std::cout << "\t--check-lexer\t\tOnly lexes the file with both lexers and reports where they disagree" << std::endl;
+    std::cout << "\t--stats\t\t\tPrints the number of parse attempts made per expression production, and how many bounds checks were eliminated" << std::endl;
+    std::cout << "\t--all-bounds-checks\tChecks every array access, even the ones proven to be in bounds" << std::endl;
+    std::cout << "\t--compact-bounds-checks\tChecks array accesses with one unsigned compare and a single trap per function reporting the line" << std::endl;
+    std::cout << "\t--short-circuit\t\tEvaluates the right operand of & and | only if the left one doesn't decide the result" << std::endl;
+    std::cout << "\t--stack-array-limit=N\tArrays of more than N bytes are allocated in the runtime's arena instead of on the stack. By default, 65536" << std::endl;
+    std::cout << "\t--inline-limit=N\tFunctions of up to N statements and expressions calling no other are inlined everywhere, and ones up to 4 times that big get copies for the constant arguments they're called with when optimizing. By default 60, 0 turns both off" << std::endl;
+    std::cout << "\t--emit=obj|exe\t\tWrites an object file (a.o) or links an executable (a.out) directly" << std::endl;
+    std::cout << "\t--output=FILENAME\tFile --emit writes to instead of a.o or a.out" << std::endl;
+    std::cout << "\t--runtime=FILENAME\truntime.o to link executables with. By default, the one next to lilang" << std::endl;
+    std::cout << "\t--run\t\t\tJIT compiles the program and runs its main, exiting with what main returns" << std::endl;
+    std::cout << "\t--interpret\t\tRuns the program in the bytecode interpreter, JIT compiling functions as they get hot" << std::endl;
+    std::cout << "\t--jit-threshold=N\tCalls plus loop iterations after which --interpret compiles a function, which runs natively from its next call. By default, 1000; 0 never compiles" << std::endl;
+    std::cout << "\t-O0|-O1|-O2|-O3\tOptimization level of the generated code. By default, -O0" << std::endl;
     std::cout << "\t-width=N\t\tUnderlying integer width of int datatype in the language. By default, N = 64" << std::endl;
     std::cout << "\t--help\t\t\tPrints this help" << std::endl;
 }
 
 int getNextTok()
 {
-	TokenInfo curTokObj = tokens[++curTokIdx];
+	const TokenInfo& curTokObj = tokens.moveTo(++curTokIdx);
     curTok = static_cast<int>(curTokObj.type);
-	curVal = curTokObj.token;
     return curTok;
 }
 
+// text of the current token; only copied out of the source when a production needs it
+std::string curVal()
+{
+    return tokens.text(tokens.peek(curTokIdx));
+}
+
+bool match(Token tok);
+
+// consumes an identifier and interns its name
+bool matchId(Symbol& name)
+{
+    if (curTok != static_cast<int>(Token::Id))
+        return false;
+    const TokenInfo& tok = tokens.peek(curTokIdx);
+    name = Interner::get().intern(tokens.data(tok), tok.text.length);
+    return match(Token::Id);
+}
+
+// type of the token `ahead' positions after the current one, without consuming anything
+int peekTok(int ahead = 1)
+{
+    return static_cast<int>(tokens.peek(curTokIdx + ahead).type);
+}
+
 void updateTokenIdx(int tokIdx) {
     curTokIdx = tokIdx - 1;
     getNextTok();
@@ -71,37 +164,35 @@ bool match(Token tok)
     return match(static_cast<int>(tok));
 }
 
-std::unique_ptr<AST::BaseStmt> parseVarDecls(int tokIdx)
+AST::BaseStmt* parseVarDecls(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
     if (isTokenType(curTok) && curTok != static_cast<int>(Token::Type_array)) {
         Token varType = static_cast<Token>(curTok);
-        std::unique_ptr<AST::VarDeclStmt> varDeclStmt(new AST::VarDeclStmt);
+        std::vector<AST::VarDecl> decls;
 
         match(curTok); // consume the type
-        while (curTok == static_cast<int>(Token::Id))
+        Symbol varName;
+        while (matchId(varName))
         {
-            std::string varName = curVal;
-            match(Token::Id); // consume 'id'
-
-            varDeclStmt->decls.push_back({varType, varName});
+            decls.push_back({varType, varName});
 
             // check if you got a comma without skipping EOLs
             if (curTok == static_cast<int>(Token::Comma))
                 match(Token::Comma);
         }
 
-        if (varDeclStmt->decls.size() >= 1)
-            return varDeclStmt;
+        if (decls.size() >= 1)
+            return makeNode<AST::VarDeclStmt>(astArena->copy(decls));
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseExpr> parseExpr(int tokIdx);
+AST::BaseExpr* parseExpr(int tokIdx);
 
-bool parseFnArgs(int tokIdx, std::vector<std::unique_ptr<AST::BaseExpr>>& fnArgs)
+bool parseFnArgs(int tokIdx, std::vector<AST::BaseExpr*>& fnArgs)
 {
     updateTokenIdx(tokIdx);
 
@@ -115,7 +206,7 @@ bool parseFnArgs(int tokIdx, std::vector<std::unique_ptr<AST::BaseExpr>>& fnArgs
                 return false;
 
             auto expr = parseExpr(curTokIdx);
-            fnArgs.push_back(std::move(expr));
+            fnArgs.push_back(expr);
 
             first = false;
         }
@@ -126,65 +217,58 @@ bool parseFnArgs(int tokIdx, std::vector<std::unique_ptr<AST::BaseExpr>>& fnArgs
     return false;
 }
 
-std::unique_ptr<AST::BaseExpr> parseTrueExpr(int tokIdx) {
+AST::BaseExpr* parseTrueExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
-    std::unique_ptr<AST::BaseExpr> res = nullptr;
+    AST::BaseExpr* res = nullptr;
     if (match(Token::Literal_true)) {
-        res = std::make_unique<AST::TrueExpr>();
+        res = makeNode<AST::TrueExpr>();
         return res;
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseExpr> parseFalseExpr(int tokIdx) {
+AST::BaseExpr* parseFalseExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
-    std::unique_ptr<AST::BaseExpr> res = nullptr;
+    AST::BaseExpr* res = nullptr;
     if (match(Token::Literal_false)) {
-        res = std::make_unique<AST::FalseExpr>();
+        res = makeNode<AST::FalseExpr>();
         return res;
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseExpr> parseNumberExpr(int tokIdx) {
+AST::BaseExpr* parseNumberExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
-    std::unique_ptr<AST::BaseExpr> res = nullptr;
-    int val = std::atoi(curVal.c_str());
+    int val = std::atoi(curVal().c_str());
     if (match(Token::Number)) {
-        return std::make_unique<AST::NumExpr>(val);
+        return makeNode<AST::NumExpr>(val);
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseExpr> parseIdentExpr(int tokIdx) {
+AST::BaseExpr* parseIdentExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
-    std::unique_ptr<AST::BaseExpr> res = nullptr;
-    auto ident = curVal;
-    if (match(Token::Id)) {
-        res = std::make_unique<AST::IdExpr>(ident);
+    AST::BaseExpr* res = nullptr;
+    Symbol ident;
+    if (matchId(ident)) {
+        res = makeNode<AST::IdExpr>(ident);
         return res;
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseExpr> parseTernaryExpr(int tokIdx) {
-    updateTokenIdx(tokIdx);
-
-    if (match(Token::PL)) {
-        auto condE = parseExpr(curTokIdx);
-        if (condE && match(Token::Op_question)) {
-            auto trueE = parseExpr(curTokIdx);
-            if (trueE && match(Token::Op_colon)) {
-                auto falseE = parseExpr(curTokIdx);
-                if (match(Token::PR)) {
-                    return std::make_unique<AST::TernaryExpr>(std::move(condE),
-                                                              std::move(trueE),
-                                                              std::move(falseE));
-                }
+// (condE ? expr : expr), called with the '(' and condE already consumed
+AST::BaseExpr* parseTernaryExpr(AST::BaseExpr* condE) {
+    if (match(Token::Op_question)) {
+        auto trueE = parseExpr(curTokIdx);
+        if (trueE && match(Token::Op_colon)) {
+            auto falseE = parseExpr(curTokIdx);
+            if (falseE && match(Token::PR)) {
+                return makeNode<AST::TernaryExpr>(condE, trueE, falseE);
             }
         }
     }
@@ -193,37 +277,41 @@ std::unique_ptr<AST::BaseExpr> parseTernaryExpr(int tokIdx) {
 }
 
 
-std::unique_ptr<AST::BaseExpr> parseSizeofExpr(int tokIdx) {
+AST::BaseExpr* parseSizeofExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
 
     if (match(Token::Sizeof) && match(Token::PL)) {
         auto idExpr = parseExpr(curTokIdx);
         if (idExpr && match(Token::PR))
-            return std::make_unique<AST::SizeofExpr>(idExpr);
+            return makeNode<AST::SizeofExpr>(idExpr);
     }
 
     return nullptr;
 }
 
 
-std::unique_ptr<AST::BaseExpr> parseInputExpr(int tokIdx) {
+AST::BaseExpr* parseInputExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
 
     if (match(Token::Input) && match(Token::PL) && match(Token::PR)) {
-        return std::make_unique<AST::InputExpr>();
+        return makeNode<AST::InputExpr>();
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseExpr> parseArrayExpr(int tokIdx) {
+AST::BaseExpr* parseArrayExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
-    std::string name = curVal;
-    if (match(Token::Id)) {
+    int line = tokens.peek(tokIdx).lineno;
+    Symbol name;
+    if (matchId(name)) {
         if (match(Token::SL)) {
             auto expr = parseExpr(curTokIdx);
-            if (expr && match(Token::SR))
-                return std::make_unique<AST::ArrayExpr>(name, std::move(expr));
+            if (expr && match(Token::SR)) {
+                auto arrayExpr = makeNode<AST::ArrayExpr>(name, expr);
+                arrayExpr->line = line;
+                return arrayExpr;
+            }
         }
     }
 
@@ -231,33 +319,49 @@ std::unique_ptr<AST::BaseExpr> parseArrayExpr(int tokIdx) {
 }
 
 
-std::unique_ptr<AST::BaseExpr> parseFncallExpr(int tokIdx) {
+AST::BaseExpr* parseFncallExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
-    std::string name = curVal;
-    if (match(Token::Id)) {
-        std::vector<std::unique_ptr<AST::BaseExpr>> fnArgs;
+    Symbol name;
+    if (matchId(name)) {
+        std::vector<AST::BaseExpr*> fnArgs;
         if (curTok == static_cast<int>(Token::PL) && parseFnArgs(curTokIdx, fnArgs))
-            return std::make_unique<AST::FnCallExpr>(name, fnArgs);
+            return makeNode<AST::FnCallExpr>(name, astArena->copy(fnArgs));
     }
 
     return nullptr;
 }
 
 
-std::unique_ptr<AST::BaseExpr> parseBinopExpr(int tokIdx) {
+// (lExpr binop expr), called with the '(' and lExpr already consumed
+AST::BaseExpr* parseBinopExpr(AST::BaseExpr* lExpr) {
+    if (isBinOp(curTok)) {
+        Token op = static_cast<Token>(curTok);
+        if (match(curTok)) { // consume binop
+            auto rExpr = parseExpr(curTokIdx);
+            if (rExpr && match(Token::PR))
+                return makeNode<AST::BinopExpr>(lExpr, op, rExpr);
+        }
+    }
+
+    return nullptr;
+}
+
+// (expr ? expr : expr) and (expr binop expr) share the prefix '(' expr, so the
+// left operand is parsed once and the token after it decides the form.
+AST::BaseExpr* parseParenExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
 
     if (match(Token::PL)) {
         auto lExpr = parseExpr(curTokIdx);
-        if (lExpr && isBinOp(curTok)) {
-            Token op = static_cast<Token>(curTok);
-            if (match(curTok)) { // consume binop
-                auto rExpr = parseExpr(curTokIdx);
-                if (rExpr && match(Token::PR))
-                    return std::make_unique<AST::BinopExpr>(std::move(lExpr),
-                                                            op,
-                                                            std::move(rExpr));
-            }
+        if (!lExpr)
+            return nullptr;
+
+        if (curTok == static_cast<int>(Token::Op_question)) {
+            parseAttempts[static_cast<int>(Production::Ternary)]++;
+            return parseTernaryExpr(lExpr);
+        } else if (isBinOp(curTok)) {
+            parseAttempts[static_cast<int>(Production::Binop)]++;
+            return parseBinopExpr(lExpr);
         }
     }
 
@@ -265,7 +369,7 @@ std::unique_ptr<AST::BaseExpr> parseBinopExpr(int tokIdx) {
 }
 
 
-std::unique_ptr<AST::BaseExpr> parseUnaryopExpr(int tokIdx) {
+AST::BaseExpr* parseUnaryopExpr(int tokIdx) {
     updateTokenIdx(tokIdx);
 
     if (match(Token::PL)) {
@@ -274,7 +378,7 @@ std::unique_ptr<AST::BaseExpr> parseUnaryopExpr(int tokIdx) {
             if (match(curTok)) { // consume unaryop
                 auto rExpr = parseExpr(curTokIdx);
                 if (rExpr && match(Token::PR))
-                    return std::make_unique<AST::UnaryExpr>(op, rExpr);
+                    return makeNode<AST::UnaryExpr>(op, rExpr);
             }
         }
     }
@@ -282,98 +386,143 @@ std::unique_ptr<AST::BaseExpr> parseUnaryopExpr(int tokIdx) {
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseExpr> parseExpr(int tokIdx)
+// Predictive expression parser: the production is picked from the current
+// token (and the one after it for identifiers and '('), so no alternative is
+// ever tried and rewound. On failure the token index is reset to tokIdx for the
+// statement parser.
+AST::BaseExpr* parseExpr(int tokIdx)
 {
+    TokenStream::Checkpoint checkpoint(tokens, tokIdx);
     updateTokenIdx(tokIdx);
-    std::unique_ptr<AST::BaseExpr> res = nullptr;
-
-    if (res = parseTrueExpr(tokIdx)) {
-        return res;
-    } else if (res = parseFalseExpr(tokIdx)) {
-        return res;
-    } else if (res = parseNumberExpr(tokIdx)) {
-        return res;
-    } else if (res = parseTernaryExpr(tokIdx)) {
-        return res;
-    } else if (res = parseSizeofExpr(tokIdx)) {
-        return res;
-    } else if (res = parseInputExpr(tokIdx)) {
-        return res;
-    } else if (res = parseArrayExpr(tokIdx)) { // ident[expr]
-        return res;
-    } else if (res = parseFncallExpr(tokIdx)) { // ident(expr)
-        return res;
-    } else if (res = parseIdentExpr(tokIdx)) { // ident
-        return res;
-    } else if (res = parseBinopExpr(tokIdx)) {
-        return res;
-    } else if (res = parseUnaryopExpr(tokIdx)) {
-        return res;
+    parseAttempts[static_cast<int>(Production::Expr)]++;
+    AST::BaseExpr* res = nullptr;
+    Production prod = Production::Count;
+
+    switch(static_cast<Token>(curTok)) {
+        case Token::Literal_true:
+            prod = Production::True;
+            res = parseTrueExpr(tokIdx);
+            break;
+        case Token::Literal_false:
+            prod = Production::False;
+            res = parseFalseExpr(tokIdx);
+            break;
+        case Token::Number:
+            prod = Production::Number;
+            res = parseNumberExpr(tokIdx);
+            break;
+        case Token::Sizeof:
+            prod = Production::Sizeof;
+            res = parseSizeofExpr(tokIdx);
+            break;
+        case Token::Input:
+            prod = Production::Input;
+            res = parseInputExpr(tokIdx);
+            break;
+        case Token::Id:
+            if (peekTok() == static_cast<int>(Token::SL)) { // ident[expr]
+                prod = Production::Array;
+                res = parseArrayExpr(tokIdx);
+            } else if (peekTok() == static_cast<int>(Token::PL)) { // ident(expr)
+                prod = Production::Fncall;
+                res = parseFncallExpr(tokIdx);
+            } else { // ident
+                prod = Production::Ident;
+                res = parseIdentExpr(tokIdx);
+            }
+            break;
+        case Token::PL:
+            if (isUnaryOp(peekTok())) { // (unaryop expr)
+                prod = Production::Unaryop;
+                res = parseUnaryopExpr(tokIdx);
+            } else { // (expr ? expr : expr) or (expr binop expr)
+                res = parseParenExpr(tokIdx);
+            }
+            break;
+        default:
+            break;
     }
 
-    updateTokenIdx(tokIdx);
-    return nullptr;
+    if (prod != Production::Count)
+        parseAttempts[static_cast<int>(prod)]++;
+
+    if (!res)
+        updateTokenIdx(tokIdx);
+    return res;
 }
 
-std::unique_ptr<AST::BaseStmt> parseArrayDecls(int tokIdx)
+void printParseStats()
+{
+    std::cout << "Parse attempts per production:" << std::endl;
+    for (int i = 0; i < static_cast<int>(Production::Count); i++) {
+        std::cout << "\t" << productionName(static_cast<Production>(i)) << "\t"
+                  << parseAttempts[i] << std::endl;
+    }
+}
+
+AST::BaseStmt* parseArrayDecls(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
     if (match(Token::Type_array))
     {
         match(Token::Type_array); // consume 'array'
-        std::unique_ptr<AST::ArrayDeclStmt> arrayDeclStmt(new AST::ArrayDeclStmt);
+        std::vector<AST::ArrayDecl> decls;
         bool first = true;
         while (curTok != static_cast<int>(Token::EOL))
         {
             if (!first && !match(Token::Comma))
                 return nullptr;
 
-            std::string varName = curVal;
-            match(Token::Id); // consume 'id'
+            Symbol varName;
+            if (!matchId(varName))
+                return nullptr;
 
             if (match(Token::SL)) {
                 auto arrayExpr = parseExpr(curTokIdx);
                 if (match(Token::SR)) {
-                    arrayDeclStmt->decls.push_back({varName, std::move(arrayExpr)});
+                    decls.push_back({varName, arrayExpr});
                     first = false;
                 }
             }
         }
 
-        if (arrayDeclStmt->decls.size() >= 1) {
-            return arrayDeclStmt;
+        if (decls.size() >= 1) {
+            return makeNode<AST::ArrayDeclStmt>(astArena->copy(decls));
         }
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseStmt> parseVarAssignment(int tokIdx)
+AST::BaseStmt* parseVarAssignment(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
-    std::string identName = curVal;
-    if (match(Token::Id) && match(Token::Op_assignment)) {
+    Symbol identName;
+    if (matchId(identName) && match(Token::Op_assignment)) {
         auto rhsExpr = parseExpr(curTokIdx);
         if (rhsExpr) {
-            return std::make_unique<AST::VarAssignment>(identName, rhsExpr);
+            return makeNode<AST::VarAssignment>(identName, rhsExpr);
         }
     }
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseStmt> parseArrayAssignment(int tokIdx)
+AST::BaseStmt* parseArrayAssignment(int tokIdx)
 {
     updateTokenIdx(tokIdx);
+    int line = tokens.peek(tokIdx).lineno;
 
-    std::string identName = curVal;
-    if (match(Token::Id) && match(Token::SL)) {
+    Symbol identName;
+    if (matchId(identName) && match(Token::SL)) {
         auto idxExpr = parseExpr(curTokIdx);
         if (idxExpr && match(Token::SR) && match(Token::Op_assignment)) {
             auto expr = parseExpr(curTokIdx);
             if (expr) {
-                return std::make_unique<AST::ArrayAssignment>(identName, idxExpr, expr);
+                auto arrayAssignment = makeNode<AST::ArrayAssignment>(identName, idxExpr, expr);
+                arrayAssignment->line = line;
+                return arrayAssignment;
             }
         }
     }
@@ -382,7 +531,7 @@ std::unique_ptr<AST::BaseStmt> parseArrayAssignment(int tokIdx)
 }
 
 // parses list of arguments which is either string or expr (and there is atleast one of such)
-bool parseStringOrExprArgs(std::vector<std::unique_ptr<AST::BaseExpr>>& args)
+bool parseStringOrExprArgs(std::vector<AST::BaseExpr*>& args)
 {
     bool ret = false;
     if (match(Token::PL))
@@ -394,14 +543,14 @@ bool parseStringOrExprArgs(std::vector<std::unique_ptr<AST::BaseExpr>>& args)
             if (!first && !match(Token::Comma))
                 return false;
 
-            std::unique_ptr<AST::BaseExpr> res = nullptr;
+            AST::BaseExpr* res = nullptr;
             if (curTok == static_cast<int>(Token::Literal_string))
             {
-                std::string val = curVal;
+                Symbol val = Interner::get().intern(tokens.stringValue(tokens.peek(curTokIdx)));
                 match(curTok); // consume string literal
-                res.reset(new AST::StringLiteralExpr(val));
+                res = makeNode<AST::StringLiteralExpr>(val);
             }
-            else if (res = parseExpr(curTokIdx))
+            else if ((res = parseExpr(curTokIdx)))
             {
                 // yay!
             }
@@ -409,7 +558,7 @@ bool parseStringOrExprArgs(std::vector<std::unique_ptr<AST::BaseExpr>>& args)
             first = false;
             if (!res)
                 return false;
-            args.push_back(std::move(res));
+            args.push_back(res);
         }
     }
 
@@ -418,38 +567,38 @@ bool parseStringOrExprArgs(std::vector<std::unique_ptr<AST::BaseExpr>>& args)
     return ret;
 }
 
-std::unique_ptr<AST::BaseStmt> parsePrintStmt(int tokIdx)
+AST::BaseStmt* parsePrintStmt(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
     if (match(Token::Print)) {
-        std::vector<std::unique_ptr<AST::BaseExpr>> args;
+        std::vector<AST::BaseExpr*> args;
         if (parseStringOrExprArgs(args)) {
-            return std::make_unique<AST::PrintStmt>(args);
+            return makeNode<AST::PrintStmt>(astArena->copy(args));
         }
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseStmt> parseAbortStmt(int tokIdx)
+AST::BaseStmt* parseAbortStmt(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
     if (match(Token::Abort)) {
-        std::vector<std::unique_ptr<AST::BaseExpr>> args;
+        std::vector<AST::BaseExpr*> args;
         if (parseStringOrExprArgs(args)) {
-            return std::make_unique<AST::AbortStmt>(args);
+            return makeNode<AST::AbortStmt>(astArena->copy(args));
         }
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseStmt> parseStmt(int tokIdx);
-std::unique_ptr<AST::StmtBlockStmt> parseStmtBlock(int tokIdx);
+AST::BaseStmt* parseStmt(int tokIdx);
+AST::StmtBlockStmt* parseStmtBlock(int tokIdx);
 
-std::unique_ptr<AST::BaseStmt> parseIfStmt(int tokIdx)
+AST::BaseStmt* parseIfStmt(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
@@ -457,19 +606,19 @@ std::unique_ptr<AST::BaseStmt> parseIfStmt(int tokIdx)
         auto condExpr = parseExpr(curTokIdx);
         if (match(Token::PR)) {
             auto body = parseStmtBlock(curTokIdx);
-            std::unique_ptr<AST::StmtBlockStmt> elseStmt = nullptr;
+            AST::StmtBlockStmt* elseStmt = nullptr;
             if (match(Token::Else)) {
                 elseStmt = parseStmtBlock(curTokIdx);
             }
             if (body)
-                return std::make_unique<AST::IfStmt>(condExpr, body, elseStmt);
+                return makeNode<AST::IfStmt>(condExpr, body, elseStmt);
         }
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseStmt> parseWhileStmt(int tokIdx)
+AST::BaseStmt* parseWhileStmt(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
@@ -478,14 +627,14 @@ std::unique_ptr<AST::BaseStmt> parseWhileStmt(int tokIdx)
         if (condExpr && match(Token::PR)) {
             auto body = parseStmtBlock(curTokIdx);
             if (body)
-                return std::make_unique<AST::WhileStmt>(condExpr, body);
+                return makeNode<AST::WhileStmt>(condExpr, body);
         }
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseStmt> parseForStmt(int tokIdx)
+AST::BaseStmt* parseForStmt(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
@@ -496,7 +645,7 @@ std::unique_ptr<AST::BaseStmt> parseForStmt(int tokIdx)
             if (containerExpr && match(Token::PR)) {
                 auto body = parseStmtBlock(curTokIdx);
                 if (body) {
-                    return std::make_unique<AST::ForStmt>(idExpr, containerExpr, body);
+                    return makeNode<AST::ForStmt>(idExpr, containerExpr, body);
                 }
             }
         }
@@ -504,100 +653,121 @@ std::unique_ptr<AST::BaseStmt> parseForStmt(int tokIdx)
     return nullptr;
 }
 
-std::unique_ptr<AST::BaseStmt> parseReturnStmt(int tokIdx)
+AST::BaseStmt* parseReturnStmt(int tokIdx)
 {
     updateTokenIdx(tokIdx);
 
     if (match(Token::Return)) {
         auto expr = parseExpr(curTokIdx);
-        return std::make_unique<AST::ReturnStmt>(expr);
+        return makeNode<AST::ReturnStmt>(expr);
     }
 
     return nullptr;
 }
 
-std::unique_ptr<AST::StmtBlockStmt> parseStmtBlock();
+AST::StmtBlockStmt* parseStmtBlock();
 
-std::unique_ptr<AST::BaseStmt> parseStmt(int tokIdx)
+// statements that fit on a single line; these are tried one after another
+AST::BaseStmt* parseSimpleStmt(int tokIdx)
 {
+    // keep the statement's tokens around so that we can go back to its start
+    TokenStream::Checkpoint checkpoint(tokens, tokIdx);
     updateTokenIdx(tokIdx);
-    std::unique_ptr<AST::BaseStmt> res = nullptr;
-    if (res = parseStmtBlock(tokIdx)) {
-        return res;
-    }
-    if (res = parseVarDecls(tokIdx))
+    AST::BaseStmt* res = nullptr;
+    if ((res = parseVarDecls(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
-    if (res = parseArrayDecls(tokIdx))
+    if ((res = parseArrayDecls(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
-    if (res = parsePrintStmt(tokIdx))
+    if ((res = parsePrintStmt(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
-    if (res = parseAbortStmt(tokIdx))
+    if ((res = parseAbortStmt(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
-    if (res = parseIfStmt(tokIdx))
-    {
-        return res;
-    }
-    if (res = parseWhileStmt(tokIdx))
-    {
-        return res;
-    }
-    if (res = parseForStmt(tokIdx))
-    {
-        return res;
-    }
-    if (res = parseVarAssignment(tokIdx))
+    if ((res = parseVarAssignment(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
-    if (res = parseArrayAssignment(tokIdx))
+    if ((res = parseArrayAssignment(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
-    if (res = parseExpr(tokIdx))
+    if ((res = parseExpr(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
-    if (res = parseReturnStmt(tokIdx))
+    if ((res = parseReturnStmt(tokIdx)))
     {
         if (match(Token::EOL))
             return res;
     }
 
-    throw Exception("Parse error near line: " + std::to_string(tokens[curTokIdx].lineno) +
-                    " token: " + tokens[curTokIdx].token);
+    const TokenInfo& errTok = tokens.peek(curTokIdx);
+    throw Exception("Parse error near line: " + std::to_string(errTok.lineno) +
+                    " token: " + tokens.text(errTok));
+}
+
+AST::BaseStmt* parseStmt(int tokIdx)
+{
+    updateTokenIdx(tokIdx);
+    const TokenInfo startTok = tokens.peek(tokIdx);
+    AST::BaseStmt* res = nullptr;
+
+    // Compound statements can span many lines. They are picked by their first
+    // token, so the token stream never has to hold on to them for backtracking.
+    switch(startTok.type) {
+        case Token::CL:
+            res = parseStmtBlock(tokIdx);
+            break;
+        case Token::If:
+            res = parseIfStmt(tokIdx);
+            break;
+        case Token::While:
+            res = parseWhileStmt(tokIdx);
+            break;
+        case Token::For:
+            res = parseForStmt(tokIdx);
+            break;
+        default:
+            return parseSimpleStmt(tokIdx);
+    }
+
+    if (!res)
+        throw Exception("Parse error near line: " + std::to_string(startTok.lineno) +
+                        " token: " + tokens.text(startTok));
+    return res;
 }
 
-std::unique_ptr<AST::StmtBlockStmt> parseStmtBlock(int tokIdx)
+AST::StmtBlockStmt* parseStmtBlock(int tokIdx)
 {
     updateTokenIdx(tokIdx);
-    std::unique_ptr<AST::StmtBlockStmt> blockStmt = nullptr;
+    AST::StmtBlockStmt* blockStmt = nullptr;
 
     if (match(Token::CL) && match(Token::EOL))
     {
-        blockStmt.reset(new AST::StmtBlockStmt);
+        std::vector<AST::BaseStmt*> stmts;
         skipEOLs();
         while (curTok != static_cast<int>(Token::CR))
         {
             auto stmt = parseStmt(curTokIdx);
             if (stmt)
-                blockStmt->stmt_list.push_back(std::move(stmt));
+                stmts.push_back(stmt);
             skipEOLs();
         }
+        blockStmt = makeNode<AST::StmtBlockStmt>(astArena->copy(stmts));
     }
 
     if (match(static_cast<int>(Token::CR)))
@@ -605,7 +775,7 @@ std::unique_ptr<AST::StmtBlockStmt> parseStmtBlock(int tokIdx)
     return nullptr;
 }
 
-std::unique_ptr<AST::StmtBlockStmt> parseFnBody()
+AST::StmtBlockStmt* parseFnBody()
 {
     return parseStmtBlock(curTokIdx);
 }
@@ -626,18 +796,13 @@ bool parseFnParams(std::vector<AST::FnParam>& args)
         if (isTokenType(curTok) && curTok != static_cast<int>(Token::Type_void))
         {
             param.type = static_cast<Token>(curTok);
-            if (getNextTok() == static_cast<int>(Token::Id))
-            {
-                param.name = curVal;
-                res = true;
-            }
+            getNextTok();
+            res = matchId(param.name);
         }
 
         first = false;
-        if (res) {
+        if (res)
             args.push_back(param);
-            getNextTok();
-        }
     }
 
     res = res && match(static_cast<int>(Token::PR));
@@ -645,36 +810,35 @@ bool parseFnParams(std::vector<AST::FnParam>& args)
     return res;
 }
 
-std::unique_ptr<AST::FunctionDefinition> parseFnDef()
+AST::FunctionDefinition* parseFnDef()
 {
     std::vector<AST::FnParam> params;
-    std::string fnName;
+    Symbol fnName;
     int fnType;
     if (!isTokenType(fnType = curTok) || !match(curTok))
         throw Exception("Unexpected type found.");
 
-    fnName = curVal;
-    if (!match(Token::Id))
+    if (!matchId(fnName))
         throw Exception("Bad function name");
 
     if (!parseFnParams(params))
         throw Exception("Cannot parse function arguments.");
 
-    std::unique_ptr<AST::FunctionPrototype> proto(
-        new AST::FunctionPrototype(fnType, fnName, params));
+    auto proto = makeNode<AST::FunctionPrototype>(fnType, fnName, astArena->copy(params));
     auto stmt = parseFnBody();
     if (!stmt)
         throw Exception("Couldn't parse function body.");
 
-    return std::make_unique<AST::FunctionDefinition>(std::move(proto), std::move(stmt));
+    return makeNode<AST::FunctionDefinition>(proto, stmt);
 }
 
 void parseProgram(AST::Program& program)
 {
+    astArena = &program.arena;
     skipEOLs();
     while (auto fnDef = parseFnDef())
     {
-        program.fnDefinitions.push_back(std::move(fnDef));
+        program.fnDefinitions.push_back(fnDef);
         if (!match(Token::EOL))
             throw Exception("New line required after fn body.");
         skipEOLs();
@@ -683,7 +847,116 @@ void parseProgram(AST::Program& program)
     }
 }
 
+// writes the object file or, for exe, links it with the runtime into an executable
+void emitOutput(llvm::Module& module, llvm::TargetMachine& tm, const std::string& kind,
+                const std::string& output, const char* argv0)
+{
+    std::string err;
+    if (kind == "obj") {
+        if (!Lilang::emitObjectFile(module, tm, output, err))
+            throw Exception(err);
+        return;
+    }
+
+    // the runtime is built next to lilang, unless told otherwise
+    std::string runtime = Lilang::Settings::get().getOptionValue("runtime");
+    if (runtime.empty()) {
+        std::string exe = llvm::sys::fs::getMainExecutable(argv0, reinterpret_cast<void*>(&emitOutput));
+        runtime = (llvm::sys::path::parent_path(exe) + "/runtime.o").str();
+    }
+
+    llvm::SmallString<128> tmpPath;
+    if (llvm::sys::fs::createTemporaryFile("lilang", "o", tmpPath))
+        throw Exception("Cannot create a temporary object file.");
+    std::string object = tmpPath.str().str();
+    bool ok = Lilang::emitObjectFile(module, tm, object, err) &&
+              Lilang::linkExecutable(object, runtime, output, err);
+    llvm::sys::fs::remove(object);
+    if (!ok)
+        throw Exception(err);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start,
+                                std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// JIT compiles the generated module and calls its main; returns what main returns
+int runProgram(std::unique_ptr<llvm::TargetMachine> tm, std::chrono::steady_clock::time_point start)
+{
+    std::cout << "  JIT compiling ...";
+    llvm::Function* mainFn = Visitor::CodegenVisitor::getModule()->getFunction("main");
+    if (!mainFn->arg_empty())
+        throw Exception("--run needs a main that takes no parameters.");
+    llvm::Type* retType = mainFn->getReturnType();
+
+    Lilang::JIT jit(std::move(tm));
+    jit.addModule(Visitor::CodegenVisitor::releaseModule());
+    uint64_t mainAddr = jit.getFunctionAddress("main");
+    if (!mainAddr)
+        throw Exception("Cannot find main in the JIT compiled code.");
+    auto compiled = std::chrono::steady_clock::now();
+    std::cout << "OK" << std::endl;
+
+    // main returns an int of -width bits, a bool or nothing; narrow values come
+    // back in the low bits of the return register
+    int64_t result = 0;
+    if (retType->isVoidTy()) {
+        reinterpret_cast<void (*)()>(mainAddr)();
+    } else {
+        result = reinterpret_cast<int64_t (*)()>(mainAddr)();
+        unsigned bits = retType->getIntegerBitWidth();
+        if (bits == 1)
+            result &= 1;
+        else if (bits < 64)
+            result = static_cast<int64_t>(static_cast<uint64_t>(result) << (64 - bits)) >> (64 - bits);
+    }
+    auto finished = std::chrono::steady_clock::now();
+
+    // what the program printed is still in the runtime's buffer
+    __l_flush();
+    std::cout << std::endl << "  Compile time: " << millisecondsSince(start, compiled) << " ms" << std::endl;
+    std::cout << "  Run time: " << millisecondsSince(compiled, finished) << " ms" << std::endl;
+    return static_cast<int>(result);
+}
+
+// runs the program in the interpreter, which JIT compiles the functions that get hot
+int interpretProgram(AST::Program& program, std::chrono::steady_clock::time_point start)
+{
+    Lilang::Settings& settingsInst = Lilang::Settings::get();
+    if (settingsInst.getWidth() != 64)
+        throw Exception("The interpreter only supports -width=64.");
+
+    std::cout << "  Compiling to bytecode ...";
+    Bytecode::Module module;
+    Visitor::BytecodeVisitor bytecodeVisitor(module);
+    bytecodeVisitor.visit(&program);
+    std::cout << "OK" << std::endl;
+
+    // hot functions are worth -O2 unless told otherwise
+    unsigned optLevel = settingsInst.getOptLevel();
+    if (optLevel == 0 && !settingsInst.isOn("O0"))
+        optLevel = 2;
+    uint32_t jitThreshold = 1000;
+    std::string thresholdVal = settingsInst.getOptionValue("jit-threshold");
+    if (!thresholdVal.empty())
+        jitThreshold = std::stoul(thresholdVal);
+
+    auto compiled = std::chrono::steady_clock::now();
+    Lilang::Interpreter interpreter(module, program, jitThreshold, optLevel);
+    int64_t result = interpreter.run();
+    auto finished = std::chrono::steady_clock::now();
+
+    // what the program printed is still in the runtime's buffer
+    __l_flush();
+    std::cout << std::endl << "  Compile time: " << millisecondsSince(start, compiled) << " ms" << std::endl;
+    std::cout << "  Run time: " << millisecondsSince(compiled, finished) << " ms" << std::endl;
+    return static_cast<int>(result);
+}
+
 int main(int argc, char* argv[]) {
+    auto startTime = std::chrono::steady_clock::now();
     std::string filename;
     Lilang::Settings& settingsInst = Lilang::Settings::get();
     for (int i = 1; i < argc; i++) {
@@ -708,26 +981,33 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // get all the tokens in the buffer
-    FILE* fp = nullptr;
-    if (!filename.empty())
-        fp = fopen(filename.c_str(), "r");
-    if (!fp) {
+    // tokens are lexed straight out of the (mapped) source text while parsing
+    SourceFile source;
+    if (!source.open(filename)) {
         std::cerr << "Error opening file " << filename << std::endl;
         return 1;
     }
-    yyrestart(fp);
 
-    int token = -1;
-    while ((token = yylex()) != 0) {
-        if (static_cast<Token>(token) == Token::Literal_string)
-            tokens.push_back({yylineno, tokenVal, static_cast<Token>(token)});
-        else
-            tokens.push_back({yylineno, std::string(yytext), static_cast<Token>(token)});
+    if (settingsInst.isOn("check-lexer"))
+        return checkLexers(source, std::cerr) ? 0 : 1;
+
+    std::string emitKind = settingsInst.getOptionValue("emit");
+    if (!emitKind.empty() && emitKind != "obj" && emitKind != "exe") {
+        std::cerr << "error: unknown output kind " << emitKind << std::endl;
+        return 1;
     }
-    tokens.push_back({yylineno, "EOF", Token::End});
 
-    fclose(fp);
+    std::unique_ptr<Lexer> lexer;
+    std::string lexerName = settingsInst.getOptionValue("lexer");
+    if (lexerName.empty() || lexerName == "flex") {
+        lexer = std::make_unique<FlexScanner>(source);
+    } else if (lexerName == "fast") {
+        lexer = std::make_unique<FastLexer>(source);
+    } else {
+        std::cerr << "error: unknown lexer " << lexerName << std::endl;
+        return 1;
+    }
+    tokens.scan(std::move(lexer), source);
 
     AST::Program programNode;
     updateTokenIdx(0);
@@ -735,12 +1015,14 @@ int main(int argc, char* argv[]) {
         std::cout << "* Parsing file: " << filename << " ... ";
         parseProgram(programNode);
         std::cout << "OK" << std::endl;
+        if (settingsInst.isOn("stats"))
+            printParseStats();
         if (settingsInst.isOn("print-ast")) {
             Visitor::PrintASTVisitor printVisitor;
             printVisitor.visit(&programNode);
         }
     } catch(Exception& exc) {
-        std::cerr << curTok << " " << curVal << std::endl;
+        std::cerr << curTok << " " << curVal() << std::endl;
         std::cout << "NOK" << std::endl;
         exc.print();
         return 1;
@@ -751,19 +1033,73 @@ int main(int argc, char* argv[]) {
         Visitor::TypecheckerVisitor typecheckerVisitor;
         typecheckerVisitor.visit(&programNode);
         std::cout << "OK" << std::endl;
+        Visitor::ConstantFoldVisitor constantFoldVisitor;
+        constantFoldVisitor.visit(&programNode);
+        if (settingsInst.isOn("stats"))
+            constantFoldVisitor.printStats(std::cout);
+        if (!settingsInst.isOn("all-bounds-checks")) {
+            std::cout << "  Eliminating bounds checks ...";
+            Visitor::BoundsCheckVisitor boundsCheckVisitor;
+            boundsCheckVisitor.visit(&programNode);
+            std::cout << "OK" << std::endl;
+            if (settingsInst.isOn("stats"))
+                boundsCheckVisitor.printStats(std::cout);
+        }
+        Visitor::CallGraphVisitor callGraphVisitor;
+        callGraphVisitor.visit(&programNode);
+        if (settingsInst.isOn("stats"))
+            callGraphVisitor.printStats(std::cout);
+        Visitor::TailCallVisitor tailCallVisitor;
+        tailCallVisitor.visit(&programNode);
+        if (settingsInst.isOn("stats"))
+            tailCallVisitor.printStats(std::cout);
     } catch(Exception& exc) {
         std::cout << "NOK" << std::endl;
         exc.print();
         return 1;
     }
 
+    if (settingsInst.isOn("interpret")) {
+        try {
+            return interpretProgram(programNode, startTime);
+        } catch(Exception& exc) {
+            std::cout << "NOK" << std::endl;
+            exc.print();
+            return 1;
+        }
+    }
+
+    unsigned optLevel = settingsInst.getOptLevel();
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    bool run = settingsInst.isOn("run");
+    if (optLevel > 0 || !emitKind.empty() || run) {
+        // the optimizer needs the target's cost model to vectorize
+        std::string err;
+        targetMachine = Lilang::createHostTargetMachine(optLevel, err);
+        if (!targetMachine && (!emitKind.empty() || run)) {
+            std::cerr << "error: " << err << std::endl;
+            return 1;
+        } else if (!targetMachine) {
+            std::cerr << "warning: optimizing without target information: " << err << std::endl;
+        }
+    }
+
     try {
         std::cout << "  Codegen-ing ...";
         Visitor::CodegenVisitor codegenVisitor;
         codegenVisitor.getModule()->setModuleIdentifier(filename);
         codegenVisitor.getModule()->setSourceFileName(filename);
+        if (targetMachine)
+            Lilang::configureModule(*codegenVisitor.getModule(), *targetMachine);
         codegenVisitor.visit(&programNode);
         std::cout << "OK" << std::endl;
+        if (optLevel > 0) {
+            std::cout << "  Optimizing (-O" << optLevel << ") ...";
+            Lilang::optimizeModule(*codegenVisitor.getModule(), targetMachine.get(), optLevel);
+            std::cout << "OK" << std::endl;
+        } else {
+            Lilang::optimizeModule(*codegenVisitor.getModule(), targetMachine.get(), 0);
+        }
         if (settingsInst.isOn("print-ir")) {
             llvm::raw_ostream& outHandle = llvm::outs();
             std::string optVal = settingsInst.getOptionValue("print-ir");
@@ -778,6 +1114,16 @@ int main(int argc, char* argv[]) {
                 codegenVisitor.getModule()->print(outHandle, nullptr);
             }
         }
+        if (!emitKind.empty()) {
+            std::string output = settingsInst.getOptionValue("output");
+            if (output.empty())
+                output = emitKind == "obj" ? "a.o" : "a.out";
+            std::cout << "  Emitting " << output << " ...";
+            emitOutput(*codegenVisitor.getModule(), *targetMachine, emitKind, output, argv[0]);
+            std::cout << "OK" << std::endl;
+        }
+        if (run)
+            return runProgram(std::move(targetMachine), startTime);
     } catch(Exception& exc) {
         std::cout << "NOK" << std::endl;
         exc.print();
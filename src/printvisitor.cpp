@@ -32,7 +32,7 @@ void Visitor::PrintASTVisitor::visit(AST::VarDeclStmt *stmt)
     _depth++;
     for (auto& var : stmt->decls)
     {
-        print({var.name, ":",
+        print({Interner::get().name(var.name), ":",
                std::to_string(static_cast<int>(var.type))});
     }
     _depth--;
@@ -44,7 +44,7 @@ void Visitor::PrintASTVisitor::visit(AST::ArrayDeclStmt *stmt)
     _depth++;
     for (auto& var : stmt->decls)
     {
-        print({var.name});
+        print({Interner::get().name(var.name)});
         _depth++;
         var.expr->accept(this);
         _depth--;
@@ -147,7 +147,7 @@ void Visitor::PrintASTVisitor::visit(AST::AbortStmt *stmt)
 void Visitor::PrintASTVisitor::visit(AST::ArrayAssignment *stmt)
 {
     print({"ident[idxExpr] = expr"});
-    print({"ident:", stmt->name});
+    print({"ident:", Interner::get().name(stmt->name)});
 
     print({"idxExpr:"});
     _depth++;
@@ -165,7 +165,7 @@ void Visitor::PrintASTVisitor::visit(AST::ArrayAssignment *stmt)
 void Visitor::PrintASTVisitor::visit(AST::VarAssignment *stmt)
 {
     print({"name = expr"});
-    print({"name: ", stmt->name});
+    print({"name: ", Interner::get().name(stmt->name)});
 
     print({"expr:"});
     _depth++;
@@ -195,7 +195,7 @@ void Visitor::PrintASTVisitor::visit(AST::FalseExpr *expr)
 
 void Visitor::PrintASTVisitor::visit(AST::IdExpr *expr)
 {
-    print({expr->name, ":ID"});
+    print({Interner::get().name(expr->name), ":ID"});
 }
 
 void Visitor::PrintASTVisitor::visit(AST::LiteralExpr *expr)
@@ -205,7 +205,7 @@ void Visitor::PrintASTVisitor::visit(AST::LiteralExpr *expr)
 
 void Visitor::PrintASTVisitor::visit(AST::StringLiteralExpr *expr)
 {
-    print({expr->val, " : string"});
+    print({Interner::get().name(expr->val), " : string"});
 }
 
 void Visitor::PrintASTVisitor::visit(AST::TernaryExpr* expr)
@@ -271,7 +271,7 @@ void Visitor::PrintASTVisitor::visit(AST::InputExpr *expr)
 void Visitor::PrintASTVisitor::visit(AST::ArrayExpr *expr)
 {
     print({"array expression : ident[expr]"});
-    print({"ident:", expr->name});
+    print({"ident:", Interner::get().name(expr->name)});
 
     print({"expr:"});
     _depth++;
@@ -283,7 +283,7 @@ void Visitor::PrintASTVisitor::visit(AST::FnCallExpr *expr)
 {
     print({"fn call expression: name(a, b, ...)"});
 
-    print({"fn_name:", expr->name});
+    print({"fn_name:", Interner::get().name(expr->name)});
     print({"fn args:"});
     for (auto& arg: expr->fnArgs)
     {
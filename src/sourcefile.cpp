@@ -0,0 +1,64 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sourcefile.hpp"
+
+SourceFile::~SourceFile()
+{
+    if (_mappedSize)
+        munmap(_data, _mappedSize);
+}
+
+bool SourceFile::read(int fd)
+{
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) > 0)
+        _buffer.insert(_buffer.end(), chunk, chunk + n);
+    if (n < 0)
+        return false;
+
+    _size = _buffer.size();
+    _buffer.push_back('\0');
+    _buffer.push_back('\0');
+    _data = _buffer.data();
+    return true;
+}
+
+bool SourceFile::open(const std::string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool res = false;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t size = static_cast<size_t>(st.st_size);
+        size_t len = (size + 2 + pageSize - 1) / pageSize * pageSize;
+
+        // reserve zeroed memory for the text plus the trailing NULs and map the file over its start
+        void* region = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region != MAP_FAILED) {
+            if (mmap(region, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+                madvise(region, size, MADV_SEQUENTIAL);
+                _data = static_cast<char*>(region);
+                _size = size;
+                _mappedSize = len;
+                res = true;
+            } else {
+                munmap(region, len);
+            }
+        }
+    }
+
+    // pipes, empty files or mmap failures
+    if (!res)
+        res = read(fd);
+
+    close(fd);
+    return res;
+}
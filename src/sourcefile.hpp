@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Text of the program being compiled, kept in memory for the whole compile
+// so that tokens can refer to it by offset instead of copying lexemes.
+// Regular files are mapped privately (flex writes NULs into the buffer it
+// scans, so pages it touches are copied on write); anything else is read
+// into a heap buffer. Either way the text is followed by the two NUL bytes
+// that flex's yy_scan_buffer expects.
+class SourceFile {
+    char* _data = nullptr;
+    size_t _size = 0;       // length of the text, without the trailing NULs
+    size_t _mappedSize = 0; // 0 if the text was read into _buffer
+    std::vector<char> _buffer;
+
+    bool read(int fd);
+
+    public:
+    SourceFile() = default;
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    ~SourceFile();
+
+    bool open(const std::string& filename);
+
+    char* data() { return _data; }
+    size_t size() const { return _size; }
+    bool isMapped() const { return _mappedSize != 0; }
+};
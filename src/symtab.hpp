@@ -1,11 +1,12 @@
 #pragma once
 
-#include <memory>
+#include <algorithm>
 #include <cassert>
-#include <unordered_map>
-#include <unordered_set>
+#include <cstdint>
+#include <vector>
 
 #include "consts.hpp"
+#include "interner.hpp"
 
 namespace AST {
     class FunctionPrototype;
@@ -29,103 +30,114 @@ class SymbolInfo
 {
     public:
     SymbolType _type;
-    virtual AST::FunctionPrototype* getFnProto() { return nullptr; }
-    SymbolInfo(SymbolType type) : _type(type) { }
-};
-
-class FnSymbolInfo : public SymbolInfo {
     AST::FunctionPrototype* _proto;
-
-    public:
-    AST::FunctionPrototype* getFnProto() override { return _proto; }
-    FnSymbolInfo(AST::FunctionPrototype* proto)
-            : SymbolInfo(SymbolType::Function)
+    AST::FunctionPrototype* getFnProto() { return _proto; }
+    SymbolInfo(SymbolType type, AST::FunctionPrototype* proto = nullptr)
+            : _type(type)
             , _proto(proto) { }
 };
 
+// All bindings that are in scope live on one stack, innermost last. Entering a
+// scope records the stack height and leaving it pops everything above that in
+// one go. `_innermost' maps every symbol id to its innermost binding on the
+// stack, and each binding remembers the one it hides, so lookups are a single
+// array access and leaving a scope restores whatever was shadowed.
 class SymbolTable
 {
-    std::unique_ptr<SymbolTable> _parent;
-    std::unordered_map<std::string, std::unique_ptr<SymbolInfo>> _table;
+    enum : uint32_t { NoBinding = 0xffffffff };
+
+    struct Binding {
+        Symbol name;
+        SymbolInfo info;
+        uint32_t shadowed;
+    };
+
+    struct Scope {
+        uint32_t height;
+        // function whose body this scope belongs to, if any
+        AST::FunctionPrototype* enclosingFn;
+    };
+
+    std::vector<Binding> _stack;
+    std::vector<Scope> _scopes;
+    std::vector<uint32_t> _innermost;
+
+    uint32_t innermost(Symbol name) const {
+        return name < _innermost.size() ? _innermost[name] : NoBinding;
+    }
 
-  public:
-    SymbolTable(std::unique_ptr<SymbolTable>&& parent)
-                    : _parent(std::move(parent)) {
+    bool add(Symbol name, const SymbolInfo& info) {
+        if (hasSymbol(name))
+            return false;
+        if (name >= _innermost.size())
+            _innermost.resize(std::max<size_t>(name + 1, Interner::get().size()), NoBinding);
+        _stack.push_back(Binding{name, info, _innermost[name]});
+        _innermost[name] = static_cast<uint32_t>(_stack.size() - 1);
+        return true;
     }
 
-    std::unique_ptr<SymbolTable>& getParent() {
-        return _parent;
+  public:
+    SymbolTable() {
+        // the global scope, which holds the functions
+        _scopes.push_back(Scope{0, nullptr});
     }
 
-    void addChild(std::unique_ptr<SymbolTable>& child) {
-  //      _children.insert(std::move(child));
+    void enterScope() {
+        _scopes.push_back(Scope{static_cast<uint32_t>(_stack.size()), _scopes.back().enclosingFn});
     }
 
-    SymbolInfo* hasSymbolInCurrentScope(const std::string& name) {
-        // only check for symbol existence in current scope
-        SymbolInfo* res = nullptr;
-        auto it = _table.find(name);
-        if (it != _table.end()) {
-            res = it->second.get();
+    void leaveScope() {
+        assert(_scopes.size() > 1 && "leaving the global scope");
+        uint32_t height = _scopes.back().height;
+        while (_stack.size() > height) {
+            const Binding& binding = _stack.back();
+            _innermost[binding.name] = binding.shadowed;
+            _stack.pop_back();
         }
-
-        return res;
+        _scopes.pop_back();
     }
 
-    SymbolInfo* hasSymbol(const std::string& name) {
-        // check if this symbol exists in our symbol table chain
-        SymbolInfo* res = nullptr;
-        SymbolTable* symTab = this;
-        do {
-            res = symTab->hasSymbolInCurrentScope(name);
-            symTab = symTab->getParent().get();
-        } while (!res && symTab != nullptr);
-
-        return res;
+    // the returned pointer is valid until the next symbol is added
+    SymbolInfo* hasSymbolInCurrentScope(Symbol name) {
+        // only check for symbol existence in current scope
+        uint32_t idx = innermost(name);
+        if (idx == NoBinding || idx < _scopes.back().height)
+            return nullptr;
+        return &_stack[idx].info;
     }
 
-    AST::FunctionPrototype* getFnProto(const std::string& name) {
-        // go to the top level sym table.
-        SymbolTable* symTab = this;
-        while (symTab->getParent().get() != nullptr) symTab = symTab->getParent().get();
+    SymbolInfo* hasSymbol(Symbol name) {
+        // check if this symbol is visible from the current scope
+        uint32_t idx = innermost(name);
+        return idx == NoBinding ? nullptr : &_stack[idx].info;
+    }
 
-        auto it = symTab->_table.find(name);
-        if (it == symTab->_table.end() || it->second->_type != SymbolType::Function)
-            throw Exception("Cannot find function name : " + name);
-        assert(it->second->getFnProto());
-        return it->second->getFnProto();
+    AST::FunctionPrototype* getFnProto(Symbol name) {
+        // functions are bound in the global scope, below anything that may shadow them
+        uint32_t globalHeight = _scopes.size() > 1 ? _scopes[1].height : _stack.size();
+        uint32_t idx = innermost(name);
+        while (idx != NoBinding && idx >= globalHeight)
+            idx = _stack[idx].shadowed;
+        if (idx == NoBinding || _stack[idx].info._type != SymbolType::Function)
+            throw Exception("Cannot find function name : " + Interner::get().name(name));
+        assert(_stack[idx].info.getFnProto());
+        return _stack[idx].info.getFnProto();
     }
 
     AST::FunctionPrototype* getEnclosingFnProto() {
-        SymbolTable* symTab = this;
-        while (symTab->getParent().get() != nullptr) {
-            if (symTab->_table.size() == 1) {
-                auto it = symTab->_table.begin();
-                if (it->first.substr(0, 6) == "lilfn_") {
-                    assert(it->second->getFnProto());
-                    return it->second->getFnProto();
-                }
-            }
-
-            symTab = symTab->getParent().get();
-        }
+        return _scopes.back().enclosingFn;
+    }
 
-        return nullptr;
+    // marks the current scope and the ones nested in it as the body of `proto'
+    void setEnclosingFnProto(AST::FunctionPrototype* proto) {
+        _scopes.back().enclosingFn = proto;
     }
 
-    bool addFnSymbol(const std::string& name, AST::FunctionPrototype* proto) {
-        if (!hasSymbol(name)) {
-            auto res = _table.emplace(name, std::make_unique<FnSymbolInfo>(proto));
-            return res.second;
-        }
-        return false;
+    bool addFnSymbol(Symbol name, AST::FunctionPrototype* proto) {
+        return add(name, SymbolInfo(SymbolType::Function, proto));
     }
 
-    bool addSymbol(const std::string& name, Token type) {
-        if (!hasSymbol(name)) {
-            auto res = _table.emplace(name, std::make_unique<SymbolInfo>(TokenToSymbolType(type)));
-            return res.second;
-        }
-        return false;
+    bool addSymbol(Symbol name, Token type) {
+        return add(name, SymbolInfo(TokenToSymbolType(type)));
     }
-};
\ No newline at end of file
+};
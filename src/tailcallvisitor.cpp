@@ -0,0 +1,165 @@
+#include "baseast.hpp"
+#include "visitor.hpp"
+
+void Visitor::TailCallVisitor::visit(AST::StmtBlockStmt *stmtBlock)
+{
+    unsigned liveArrays = _liveArrays;
+    for (auto& stmt : stmtBlock->stmt_list)
+    {
+        stmt->accept(this);
+        if (auto arrayDecl = dynamic_cast<AST::ArrayDeclStmt*>(stmt))
+            _liveArrays += arrayDecl->decls.size();
+        else if (dynamic_cast<AST::ReturnStmt*>(stmt))
+            break; // the rest is never run
+    }
+    _liveArrays = liveArrays;
+}
+
+void Visitor::TailCallVisitor::visit(AST::VarDeclStmt *stmt)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::ArrayDeclStmt *stmt)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::PrintStmt *stmt)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::IfStmt *stmt)
+{
+    stmt->trueStmt->accept(this);
+    if (stmt->falseStmt)
+        stmt->falseStmt->accept(this);
+}
+
+void Visitor::TailCallVisitor::visit(AST::WhileStmt *stmt)
+{
+    stmt->body->accept(this);
+}
+
+void Visitor::TailCallVisitor::visit(AST::ForStmt *stmt)
+{
+    stmt->body->accept(this);
+}
+
+void Visitor::TailCallVisitor::visit(AST::ReturnStmt *stmt)
+{
+    auto call = dynamic_cast<AST::FnCallExpr*>(stmt->returnExpr);
+    if (!call || _liveArrays > 0)
+        return;
+
+    if (call->name == _fnDef->proto->fnName) {
+        call->tailCall = AST::TailCall::Self;
+        _fnDef->selfTailCalls = true;
+        _numSelf++;
+    } else {
+        call->tailCall = AST::TailCall::Sibling;
+        _numSibling++;
+    }
+}
+
+void Visitor::TailCallVisitor::visit(AST::AbortStmt *stmt)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::ArrayAssignment *stmt)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::VarAssignment *stmt)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::BaseExpr* expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::TrueExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::FalseExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::NumExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::IdExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::LiteralExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::StringLiteralExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::TernaryExpr* expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::BinopExpr* expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::UnaryExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::SizeofExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::InputExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::ArrayExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::FnCallExpr *expr)
+{
+
+}
+
+void Visitor::TailCallVisitor::visit(AST::Program* program)
+{
+    for (auto& fnDef : program->fnDefinitions) {
+        _fnDef = fnDef;
+        _liveArrays = 0;
+        fnDef->body->accept(this);
+    }
+}
+
+void Visitor::TailCallVisitor::printStats(std::ostream& out) const
+{
+    out << "Calls in tail position:" << std::endl;
+    out << "\tsibling\t" << _numSibling << std::endl;
+    out << "\tself\t" << _numSelf << std::endl;
+}
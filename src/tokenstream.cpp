@@ -0,0 +1,58 @@
+#include <algorithm>
+
+#include "tokenstream.hpp"
+
+void TokenStream::grow()
+{
+    std::vector<TokenInfo> ring(_ring.size() * 2);
+    for (int i = _begin; i < _end; i++)
+        ring[i & (ring.size() - 1)] = slot(i);
+    _ring.swap(ring);
+}
+
+void TokenStream::lexNext()
+{
+    if (_end - _begin == static_cast<int>(_ring.size())) {
+        // recycle everything the parser can't go back to anymore
+        int lowWater = _cur;
+        if (!_checkpoints.empty())
+            lowWater = std::min(lowWater, _checkpoints.front());
+        _begin = std::max(_begin, lowWater);
+        if (_end - _begin == static_cast<int>(_ring.size()))
+            grow();
+    }
+
+    TokenInfo& tok = slot(_end++);
+    if (_eof) {
+        // keep handing out End once the input is exhausted
+        tok.type = Token::End;
+        tok.lineno = _eofLine;
+        tok.text = SourceSpan();
+        return;
+    }
+
+    _lexer->next(tok);
+    _eof = tok.type == Token::End;
+    _eofLine = tok.lineno;
+}
+
+std::string TokenStream::stringValue(const TokenInfo& tok) const
+{
+    const char* str = data(tok);
+    const size_t len = tok.text.length;
+    std::string res;
+    res.reserve(len);
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] == '"') {
+            continue;
+        }
+        else if (i < len - 1 && str[i] == '\\' && str[i + 1] == 'n') {
+            res.push_back('\n');
+            i++;
+            continue;
+        }
+        else
+            res.push_back(str[i]);
+    }
+    return res;
+}
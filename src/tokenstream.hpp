@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cassert>
+
+#include "consts.hpp"
+#include "lexer.hpp"
+#include "sourcefile.hpp"
+
+// Tokens are pulled from the lexer on demand and kept in a ring buffer, so
+// lexing is interleaved with parsing and only a window of the token stream
+// is alive at any time. Tokens are addressed by their absolute index in the
+// stream. Everything from the oldest checkpoint (or the current token if
+// there's none) onwards is retained; older tokens are recycled.
+// The lexer scans the source buffer in place and tokens only record where
+// their text is, so no lexeme is copied until the parser asks for it.
+class TokenStream {
+    std::vector<TokenInfo> _ring;
+    int _begin = 0;   // index of the oldest retained token
+    int _end = 0;     // index one past the newest lexed token
+    int _cur = 0;     // index of the token the parser is at
+    bool _eof = false;
+    int _eofLine = 0;
+    std::vector<int> _checkpoints;
+    std::unique_ptr<Lexer> _lexer;
+    const char* _source = nullptr;
+
+    void lexNext();
+    void grow();
+    TokenInfo& slot(int idx) { return _ring[idx & (_ring.size() - 1)]; }
+
+    public:
+    // capacity must be a power of two
+    explicit TokenStream(size_t capacity = 64) : _ring(capacity) { }
+
+    // start lexing `src' with `lexer'; `src' has to outlive the token stream
+    void scan(std::unique_ptr<Lexer> lexer, SourceFile& src) {
+        _lexer = std::move(lexer);
+        _source = src.data();
+    }
+
+    // move the parser to token `idx' and return it
+    const TokenInfo& moveTo(int idx) {
+        _cur = idx;
+        return peek(idx);
+    }
+
+    // look at token `idx' without moving the parser there
+    const TokenInfo& peek(int idx) {
+        assert(idx >= _begin && "token was already recycled; missing checkpoint?");
+        while (idx >= _end)
+            lexNext();
+        return slot(idx);
+    }
+
+    const char* data(const TokenInfo& tok) const {
+        return _source + tok.text.offset;
+    }
+
+    std::string text(const TokenInfo& tok) const {
+        // End has no text in the source
+        if (tok.type == Token::End)
+            return "EOF";
+        return std::string(data(tok), tok.text.length);
+    }
+
+    // value of a string literal token, with quotes dropped and escapes decoded
+    std::string stringValue(const TokenInfo& tok) const;
+
+    // Pins token `idx' and everything after it in the buffer, so that the
+    // parser can go back to it. Checkpoints are released in LIFO order.
+    class Checkpoint {
+        TokenStream& _stream;
+        public:
+        Checkpoint(TokenStream& stream, int idx) : _stream(stream) {
+            assert(idx >= _stream._begin);
+            _stream._checkpoints.push_back(idx);
+        }
+        ~Checkpoint() {
+            _stream._checkpoints.pop_back();
+        }
+    };
+};
@@ -19,8 +19,8 @@ void Visitor::TypecheckerVisitor::visit(AST::VarDeclStmt *stmt)
 {
     for (auto& var : stmt->decls)
     {
-        if (!_symTab->addSymbol(var.name, var.type))
-            throw Exception("redeclaring variable " + var.name, ExceptionType::Type);
+        if (!_symTab.addSymbol(var.name, var.type))
+            throw Exception("redeclaring variable " + Interner::get().name(var.name), ExceptionType::Type);
     }
 }
 
@@ -30,10 +30,10 @@ void Visitor::TypecheckerVisitor::visit(AST::ArrayDeclStmt *stmt)
     {
         var.expr->accept(this);
         // check if this expression is an int value
-        if (!var.expr->result->isIntValue())
+        if (!var.expr->result.isIntValue())
             throw Exception("Expected an expression with value int");
-        if (!_symTab->addSymbol(var.name, Token::Type_array))
-            throw Exception("redeclaring array " + var.name, ExceptionType::Type);
+        if (!_symTab.addSymbol(var.name, Token::Type_array))
+            throw Exception("redeclaring array " + Interner::get().name(var.name), ExceptionType::Type);
     }
 }
 
@@ -42,7 +42,7 @@ void Visitor::TypecheckerVisitor::visit(AST::PrintStmt *stmt)
     for (auto& expr : stmt->args)
     {
         expr->accept(this);
-        if (!expr->result->isStringValue() && !expr->result->isIntValue())
+        if (!expr->result.isStringValue() && !expr->result.isIntValue())
             throw Exception("only string literals and int identifiers allowed in print args", ExceptionType::Type);
     }
 }
@@ -50,7 +50,7 @@ void Visitor::TypecheckerVisitor::visit(AST::PrintStmt *stmt)
 void Visitor::TypecheckerVisitor::visit(AST::IfStmt *stmt)
 {
     stmt->cond->accept(this);
-    if (!stmt->cond->result->isBoolValue())
+    if (!stmt->cond->result.isBoolValue())
         throw Exception("Only bool value allowed as if stmt condition.", ExceptionType::Type);
 
     stmt->trueStmt->accept(this);
@@ -64,7 +64,7 @@ void Visitor::TypecheckerVisitor::visit(AST::IfStmt *stmt)
 void Visitor::TypecheckerVisitor::visit(AST::WhileStmt *stmt)
 {
     stmt->cond->accept(this);
-    if (!stmt->cond->result->isBoolValue())
+    if (!stmt->cond->result.isBoolValue())
         throw Exception("Only bool value allowed as while stmt condition.", ExceptionType::Type);
 
     stmt->body->accept(this);
@@ -75,18 +75,18 @@ void Visitor::TypecheckerVisitor::visit(AST::ForStmt *stmt)
 {
     EnterScope();
     // declare variable before : in the for statement
-    AST::IdExpr* idExpr = dynamic_cast<AST::IdExpr*>(stmt->ident.get());
+    AST::IdExpr* idExpr = dynamic_cast<AST::IdExpr*>(stmt->ident);
     if (!idExpr)
         throw Exception("Malformed for statement; expected an identifier, got something else.");
-    if (!_symTab->addSymbol(idExpr->name, Token::Type_int))
-        throw Exception("Redeclaring identifier, "  + idExpr->name + " in for statement.");
+    if (!_symTab.addSymbol(idExpr->name, Token::Type_int))
+        throw Exception("Redeclaring identifier, "  + Interner::get().name(idExpr->name) + " in for statement.");
 
     stmt->ident->accept(this);
-    if (!stmt->ident->result->isIntValue())
+    if (!stmt->ident->result.isIntValue())
         throw Exception("Id expected in for stmt before colon", ExceptionType::Type);
 
     stmt->container->accept(this);
-    if (!stmt->container->result->isArrayValue())
+    if (!stmt->container->result.isArrayValue())
         throw Exception("array expected in for stmt after colon", ExceptionType::Type);
 
     stmt->body->accept(this);
@@ -97,12 +97,12 @@ void Visitor::TypecheckerVisitor::visit(AST::ForStmt *stmt)
 void Visitor::TypecheckerVisitor::visit(AST::ReturnStmt *stmt)
 {
     Token retExprType = Token::Type_void;
-    auto m = _symTab->getEnclosingFnProto();
+    auto m = _symTab.getEnclosingFnProto();
     Token expectedRetType = m->fnType;
     if (stmt->returnExpr)
     {
         stmt->returnExpr->accept(this);
-        retExprType = stmt->returnExpr->result->getType();
+        retExprType = stmt->returnExpr->result.getType();
     }
 
     if (retExprType != expectedRetType)
@@ -114,7 +114,7 @@ void Visitor::TypecheckerVisitor::visit(AST::AbortStmt *stmt)
     for (auto& expr : stmt->args)
     {
         expr->accept(this);
-        if (!expr->result->isStringValue() && !expr->result->isIntValue())
+        if (!expr->result.isStringValue() && !expr->result.isIntValue())
             throw Exception("only string or int allowed as abort stmt arguments", ExceptionType::Type);
     }
 }
@@ -122,25 +122,25 @@ void Visitor::TypecheckerVisitor::visit(AST::AbortStmt *stmt)
 void Visitor::TypecheckerVisitor::visit(AST::ArrayAssignment *stmt)
 {
     SymbolInfo* info = nullptr;
-    if (!(info = _symTab->hasSymbol(stmt->name)))
+    if (!(info = _symTab.hasSymbol(stmt->name)))
         throw Exception("Assigning element to an undeclared array.");
     if (info->_type != SymbolType::Array)
         throw Exception("Only arrays can be indexed using [] operator");
     stmt->idxExpr->accept(this);
-    if (!stmt->idxExpr->result->isIntValue())
+    if (!stmt->idxExpr->result.isIntValue())
         throw Exception("only int allowed as array index");
     stmt->expr->accept(this);
-    if (!stmt->expr->result->isIntValue())
+    if (!stmt->expr->result.isIntValue())
         throw Exception("rhs of array assignment must be int");
 }
 
 void Visitor::TypecheckerVisitor::visit(AST::VarAssignment *stmt)
 {
     SymbolInfo* info = nullptr;
-    if (!(info =_symTab->hasSymbol(stmt->name)))
+    if (!(info =_symTab.hasSymbol(stmt->name)))
         throw Exception("Undeclared variable is being assigned.");
     stmt->expr->accept(this);
-    const Token rhsType = stmt->expr->result->getType();
+    const Token rhsType = stmt->expr->result.getType();
     const Token lhsType = SymbolToTokenType(info->_type);
     if (lhsType != rhsType)
         throw Exception("unmatched types in var assignment.");
@@ -169,8 +169,8 @@ void Visitor::TypecheckerVisitor::visit(AST::NumExpr *expr)
 void Visitor::TypecheckerVisitor::visit(AST::IdExpr *expr)
 {
     SymbolInfo* sym = nullptr;
-    if (!(sym = _symTab->hasSymbol(expr->name)))
-        throw Exception("undefined symbol " + expr->name, ExceptionType::Type);
+    if (!(sym = _symTab.hasSymbol(expr->name)))
+        throw Exception("undefined symbol " + Interner::get().name(expr->name), ExceptionType::Type);
 
     expr->result = AST::createValue(SymbolToTokenType(sym->_type));
 }
@@ -182,20 +182,20 @@ void Visitor::TypecheckerVisitor::visit(AST::LiteralExpr *expr)
 
 void Visitor::TypecheckerVisitor::visit(AST::StringLiteralExpr *expr)
 {
-    expr->result = std::make_unique<AST::StringValue>();
+    expr->result = AST::createValue(Token::Literal_string);
 }
 
 void Visitor::TypecheckerVisitor::visit(AST::TernaryExpr* expr)
 {
     expr->condExpr->accept(this);
-    if (!expr->condExpr->result->isBoolValue())
+    if (!expr->condExpr->result.isBoolValue())
         throw Exception("first arg to ternary expr should be bool type");
 
     expr->trueExpr->accept(this);
-    Token trueType = expr->trueExpr->result->getType();
+    Token trueType = expr->trueExpr->result.getType();
 
     expr->falseExpr->accept(this);
-    Token falseType = expr->falseExpr->result->getType();
+    Token falseType = expr->falseExpr->result.getType();
 
     if (trueType != falseType)
         throw Exception("ternary: true and false expression should be same type");
@@ -208,10 +208,10 @@ void Visitor::TypecheckerVisitor::visit(AST::BinopExpr* expr)
     const Token op = expr->op;
 
     expr->leftExpr->accept(this);
-    Token lType = expr->leftExpr->result->getType();
+    Token lType = expr->leftExpr->result.getType();
 
     expr->rightExpr->accept(this);
-    Token rType = expr->rightExpr->result->getType();
+    Token rType = expr->rightExpr->result.getType();
 
     if (lType != rType) {
         throw Exception("binop operands must be same type.");
@@ -240,21 +240,21 @@ void Visitor::TypecheckerVisitor::visit(AST::UnaryExpr *expr)
     const Token op = expr->type;
     expr->expr->accept(this);
     if (op == Token::Op_bang) {
-        if (!expr->expr->result->isBoolValue())
+        if (!expr->expr->result.isBoolValue())
             throw Exception("Bool expected with bang operator");
     } else if (op == Token::Op_minus) {
-        if (!expr->expr->result->isIntValue())
+        if (!expr->expr->result.isIntValue())
             throw Exception("Only int allowed with minus unary op");
     } else
         assert("Wrong operator found in unary Expr.");
 
-    expr->result = AST::createValue(expr->expr->result->getType());
+    expr->result = AST::createValue(expr->expr->result.getType());
 }
 
 void Visitor::TypecheckerVisitor::visit(AST::SizeofExpr *expr)
 {
     expr->idExpr->accept(this);
-    if (!expr->idExpr->result->isArrayValue())
+    if (!expr->idExpr->result.isArrayValue())
         throw Exception("Sizeof argument should be an array value");
     expr->result = AST::createValue(Token::Type_int);
 }
@@ -267,25 +267,25 @@ void Visitor::TypecheckerVisitor::visit(AST::InputExpr *expr)
 void Visitor::TypecheckerVisitor::visit(AST::ArrayExpr *expr)
 {
     expr->expr->accept(this);
-    if (!expr->expr->result->isIntValue())
+    if (!expr->expr->result.isIntValue())
         throw Exception("Only int allowed as array expression argument");
     expr->result = AST::createValue(Token::Type_int);
 }
 
 void Visitor::TypecheckerVisitor::visit(AST::FnCallExpr *expr)
 {
-    if (!_symTab->hasSymbol(expr->name))
-        throw Exception("calling undefined function : " + expr->name, ExceptionType::Type);
+    if (!_symTab.hasSymbol(expr->name))
+        throw Exception("calling undefined function : " + Interner::get().name(expr->name), ExceptionType::Type);
 
-    AST::FunctionPrototype* fnProto = _symTab->getFnProto(expr->name);
+    AST::FunctionPrototype* fnProto = _symTab.getFnProto(expr->name);
     if (expr->fnArgs.size() != fnProto->fnParams.size())
-        throw Exception("Function " + fnProto->fnName + " expects different number of arguments than given.");
+        throw Exception("Function " + Interner::get().name(fnProto->fnName) + " expects different number of arguments than given.");
 
     int i = 0;
     for (auto& arg: expr->fnArgs)
     {
         arg->accept(this);
-        const Token argType = arg->result->getType();
+        const Token argType = arg->result.getType();
         const Token paramType = fnProto->fnParams[i].type;
         if (argType != paramType)
             throw Exception("Fn call arg types mismatch.");
@@ -300,28 +300,25 @@ void Visitor::TypecheckerVisitor::visit(AST::Program* program)
     // add functions to symbol table in first pass
     for (auto &fnDef : program->fnDefinitions)
     {
-        if (!_symTab->addFnSymbol(fnDef->proto->fnName, fnDef->proto.get()))
-            throw Exception("redefining function :" + fnDef->proto->fnName, ExceptionType::Type);
+        if (!_symTab.addFnSymbol(fnDef->proto->fnName, fnDef->proto))
+            throw Exception("redefining function :" + Interner::get().name(fnDef->proto->fnName), ExceptionType::Type);
     }
 
     // exactly one main should be there.
-    if (!_symTab->hasSymbolInCurrentScope("main"))
+    if (!_symTab.hasSymbolInCurrentScope(Interner::get().intern("main")))
         throw Exception("one main function required", ExceptionType::Type);
 
     // iterate over individual funcs
     for (auto& fnDef : program->fnDefinitions)
     {
-        // following hack is because return statement wants to know the type of the function in which it's enclosed in
-        // And we cannot make use of top-level symbol table (which contains all the functions) because we don't know the name of the function
-        // in which the return statement is enclosed.
-        // functions have a completely new scope with only internal function name in that scope
-        EnterScope();
-        _symTab->addFnSymbol("lilfn_ " + fnDef->proto->fnName, fnDef->proto.get());
+        // return statements need the type of the function they are in, which every
+        // scope inside the function can tell
         EnterScope();
+        _symTab.setEnclosingFnProto(fnDef->proto);
         for(auto& param : fnDef->proto->fnParams)
         {
-            if(!_symTab->addSymbol(param.name, param.type))
-                throw Exception("redeclaring variable : " + param.name, ExceptionType::Type);
+            if(!_symTab.addSymbol(param.name, param.type))
+                throw Exception("redeclaring variable : " + Interner::get().name(param.name), ExceptionType::Type);
         }
         fnDef->body->accept(this);
 
@@ -331,14 +328,13 @@ void Visitor::TypecheckerVisitor::visit(AST::Program* program)
         bool lastStmtConditionMet = true;
         if (fnDef->proto->fnType != Token::Type_void) {
             lastStmtConditionMet = false;
-            if (dynamic_cast<AST::AbortStmt*>(lastStmt.get()) ||
-                dynamic_cast<AST::ReturnStmt*>(lastStmt.get()))
+            if (dynamic_cast<AST::AbortStmt*>(lastStmt) ||
+                dynamic_cast<AST::ReturnStmt*>(lastStmt))
                 lastStmtConditionMet = true;
         }
         if (!lastStmtConditionMet)
             throw Exception("Last statement of non-void function should be return or abort.");
 
         LeaveScope();
-        LeaveScope();
     }
 }
\ No newline at end of file
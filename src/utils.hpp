@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <unordered_set>
 
 namespace Lilang {
@@ -39,6 +40,15 @@ namespace Lilang {
             return res;
         }
 
+        // level given with -O0 ... -O3, 0 if there's none
+        unsigned getOptLevel() {
+            for (unsigned level = 3; level > 0; level--) {
+                if (isOn("O" + std::to_string(level)))
+                    return level;
+            }
+            return 0;
+        }
+
         static Settings& get() {
             static Settings SettingsInstance;
             return SettingsInstance;
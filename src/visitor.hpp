@@ -3,9 +3,11 @@
 #include <iostream>
 #include <cassert>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <stack>
 #include <utility>
+#include <vector>
 
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Function.h>
@@ -15,12 +17,16 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
 
+#include "arena.hpp"
 #include "consts.hpp"
 #include "symtab.hpp"
+#include "interner.hpp"
+#include "bytecode.hpp"
 
 namespace AST {
     class FunctionDefinition;
     class Program;
+    enum class BoundsCheck : uint8_t;
 
     class BaseStmt;
     class BaseExpr;
@@ -123,7 +129,7 @@ namespace Visitor {
     };
 
     class TypecheckerVisitor : public BaseVisitor {
-        std::unique_ptr<SymbolTable> _symTab;
+        SymbolTable _symTab;
 
         public:
         virtual void visit(AST::BaseStmt* stmt) { std::cout << "Typechecker visitor " << std::endl; };
@@ -156,34 +162,358 @@ namespace Visitor {
 
         virtual void visit(AST::Program*) override;
 
-        TypecheckerVisitor() {
-            _symTab = std::make_unique<SymbolTable>(nullptr);
-        }
-        ~TypecheckerVisitor() {
-
-        }
         void EnterScope() {
-            std::unique_ptr<SymbolTable> newSymTab = std::make_unique<SymbolTable>(std::move(_symTab));
-            _symTab = std::move(newSymTab);
+            _symTab.enterScope();
         }
 
         void LeaveScope() {
-            _symTab = std::move(_symTab->getParent());
+            _symTab.leaveScope();
         }
     };
 
+    // Folds the expressions whose operands are constants, wrapping around at
+    // the -width in use like the generated code, and drops the statements
+    // that can't run: branches a constant condition never takes, and what
+    // follows a return or an abort. Runs right after the typechecker, so the
+    // later passes see the simplified program.
+    class ConstantFoldVisitor : public BaseVisitor {
+        Arena* _arena = nullptr;
+        size_t _width = 64;
+        // what the last visited expression or statement is replaced with; a
+        // null statement is dropped
+        AST::BaseExpr* _expr = nullptr;
+        AST::BaseStmt* _stmt = nullptr;
+        unsigned _numFolded = 0;
+        unsigned _numRemoved = 0;
+
+        AST::BaseExpr* fold(AST::BaseExpr* expr);
+        // `val' as the -width bit int it ends up as
+        int64_t wrap(uint64_t val) const;
+        // null if `val' doesn't fit in a NumExpr
+        AST::BaseExpr* makeInt(int64_t val);
+        AST::BaseExpr* makeBool(bool val);
+        AST::BaseExpr* foldInts(Token op, int64_t lhs, int64_t rhs);
+
+        public:
+        virtual void visit(AST::BaseStmt* stmt) { std::cout << "ConstantFold visitor " << std::endl; };
+        virtual void visit(AST::StmtBlockStmt* stmtBlock) override;
+        virtual void visit(AST::VarDeclStmt*) override;
+        virtual void visit(AST::ArrayDeclStmt*) override;
+        virtual void visit(AST::PrintStmt* stmt) override;
+        virtual void visit(AST::IfStmt*) override;
+        virtual void visit(AST::WhileStmt*) override;
+        virtual void visit(AST::ForStmt*) override;
+        virtual void visit(AST::ReturnStmt*) override;
+        virtual void visit(AST::AbortStmt*) override;
+        virtual void visit(AST::ArrayAssignment*) override;
+        virtual void visit(AST::VarAssignment*) override;
+
+        virtual void visit(AST::BaseExpr*) override;
+        virtual void visit(AST::TrueExpr*) override;
+        virtual void visit(AST::FalseExpr*) override;
+        virtual void visit(AST::NumExpr*) override;
+        virtual void visit(AST::IdExpr*) override;
+        virtual void visit(AST::LiteralExpr*) override;
+        virtual void visit(AST::StringLiteralExpr*) override;
+        virtual void visit(AST::TernaryExpr*) override;
+        virtual void visit(AST::BinopExpr*) override;
+        virtual void visit(AST::UnaryExpr*) override;
+        virtual void visit(AST::SizeofExpr*) override;
+        virtual void visit(AST::InputExpr*) override;
+        virtual void visit(AST::ArrayExpr*) override;
+        virtual void visit(AST::FnCallExpr*) override;
+
+        virtual void visit(AST::Program*) override;
+
+        void printStats(std::ostream& out) const;
+    };
+
+    // Decides which array accesses need a bounds check, see AST::BoundsCheck.
+    // Walks every function tracking what is known about its int variables:
+    // constant bounds, and how far below the size of an array they are. An
+    // access whose index is proven to be in bounds isn't checked; one whose
+    // array and index don't change in a loop is checked once in front of it.
+    class BoundsCheckVisitor : public BaseVisitor {
+        // what is known about the value of an int
+        struct Range {
+            int64_t lower;
+            int64_t upper;
+            // (arr, d): the value is less than sizeof(arr) - d; sorted by arr
+            std::vector<std::pair<Symbol, int64_t>> below;
+
+            bool operator==(const Range& other) const {
+                return lower == other.lower && upper == other.upper && below == other.below;
+            }
+        };
+
+        // what is known at a point of the function
+        struct State {
+            bool reachable = true;
+            // int variables missing here can have any value
+            std::unordered_map<Symbol, Range> ranges;
+            // int variables holding the size of an array
+            std::unordered_map<Symbol, Symbol> sizeVars;
+            // arrays of a constant size
+            std::unordered_map<Symbol, int64_t> sizes;
+
+            bool operator==(const State& other) const {
+                return reachable == other.reachable && ranges == other.ranges &&
+                       sizeVars == other.sizeVars && sizes == other.sizes;
+            }
+        };
+
+        // an int expression as `sym' + `offset', where `sym' is nothing, a
+        // variable or the size of an array
+        struct Linear {
+            enum Kind { Unknown, Const, Var, Size } kind = Unknown;
+            Symbol sym = 0;
+            int64_t offset = 0;
+        };
+
+        struct Loop {
+            ArenaArray<AST::BaseStmt*>* hoistedChecks;
+            // variables and arrays assigned or declared in the loop
+            std::unordered_set<Symbol> assigned;
+        };
+
+        State _state;
+        // range of the int type for the -width in use
+        int64_t _min;
+        int64_t _max;
+        // loops around the current statement, outermost first
+        std::vector<Loop> _loops;
+
+        // how an access is checked; accesses in loops are decided once per pass
+        // over the loop and the last pass is the one that counts
+        struct Decision {
+            AST::BoundsCheck check;
+            // the loop a Hoisted check goes in front of
+            ArenaArray<AST::BaseStmt*>* loop;
+            // keeps the hoisted checks of a loop in program order
+            unsigned order;
+        };
+        std::unordered_map<AST::BaseStmt*, Decision> _decisions;
+        unsigned _numDecided = 0;
+        unsigned _numAccesses = 0;
+        unsigned _numRemoved = 0;
+        unsigned _numHoisted = 0;
+
+        Range anyValue() const { return Range{_min, _max, {}}; }
+        Linear linear(AST::BaseExpr* expr) const;
+        Range rangeOf(const Linear& value) const;
+        // restricts the value of `var' to `range'; marks the state unreachable
+        // if that leaves no value
+        void narrow(Symbol var, const Range& range);
+        void join(State& into, const State& other) const;
+        // drops the facts of `next' that got weaker since `prev', so that loops
+        // counting down still reach a fixpoint quickly
+        void widen(State& next, const State& prev) const;
+        // refines the state with `cond' being `truth'
+        void assume(AST::BaseExpr* cond, bool truth);
+        // `left' < `right', or <= if not `strict'
+        void assumeLess(AST::BaseExpr* left, AST::BaseExpr* right, bool strict);
+        void assign(Symbol var, AST::BaseExpr* expr);
+        void forgetArray(Symbol arr);
+        void markAssigned(Symbol name);
+        bool isInBounds(Symbol arr, AST::BaseExpr* idx) const;
+        bool isInvariant(AST::BaseExpr* expr, const std::unordered_set<Symbol>& assigned) const;
+        AST::BoundsCheck classify(AST::BaseStmt* access, Symbol arr, AST::BaseExpr* idx);
+        // runs `body' to a fixpoint of the state at the head of the loop
+        template <typename Body>
+        void analyzeLoop(ArenaArray<AST::BaseStmt*>* hoistedChecks, Body body);
+
+        public:
+        virtual void visit(AST::BaseStmt* stmt) { std::cout << "BoundsCheck visitor " << std::endl; };
+        virtual void visit(AST::StmtBlockStmt* stmtBlock) override;
+        virtual void visit(AST::VarDeclStmt*) override;
+        virtual void visit(AST::ArrayDeclStmt*) override;
+        virtual void visit(AST::PrintStmt* stmt) override;
+        virtual void visit(AST::IfStmt*) override;
+        virtual void visit(AST::WhileStmt*) override;
+        virtual void visit(AST::ForStmt*) override;
+        virtual void visit(AST::ReturnStmt*) override;
+        virtual void visit(AST::AbortStmt*) override;
+        virtual void visit(AST::ArrayAssignment*) override;
+        virtual void visit(AST::VarAssignment*) override;
+
+        virtual void visit(AST::BaseExpr*) override;
+        virtual void visit(AST::TrueExpr*) override;
+        virtual void visit(AST::FalseExpr*) override;
+        virtual void visit(AST::NumExpr*) override;
+        virtual void visit(AST::IdExpr*) override;
+        virtual void visit(AST::LiteralExpr*) override;
+        virtual void visit(AST::StringLiteralExpr*) override;
+        virtual void visit(AST::TernaryExpr*) override;
+        virtual void visit(AST::BinopExpr*) override;
+        virtual void visit(AST::UnaryExpr*) override;
+        virtual void visit(AST::SizeofExpr*) override;
+        virtual void visit(AST::InputExpr*) override;
+        virtual void visit(AST::ArrayExpr*) override;
+        virtual void visit(AST::FnCallExpr*) override;
+
+        virtual void visit(AST::Program*) override;
+
+        void printStats(std::ostream& out) const;
+    };
+
+    // Builds the call graph of the program. It's a closed world, only main is
+    // called from outside, so what a function is called with is known from
+    // its call sites. Picks the functions to inline and to specialize, see
+    // AST::FunctionDefinition::alwaysInline.
+    class CallGraphVisitor : public BaseVisitor {
+        struct Node {
+            // functions it calls, each once
+            std::vector<AST::FunctionDefinition*> callees;
+            // statements and expressions in its body
+            unsigned size = 0;
+        };
+        std::unordered_map<Symbol, AST::FunctionDefinition*> _fnDefs;
+        std::unordered_map<AST::FunctionDefinition*, Node> _nodes;
+        Node* _node = nullptr;
+        unsigned _numInlined = 0;
+        unsigned _numSpecialized = 0;
+
+        public:
+        virtual void visit(AST::BaseStmt* stmt) { std::cout << "CallGraph visitor " << std::endl; };
+        virtual void visit(AST::StmtBlockStmt* stmtBlock) override;
+        virtual void visit(AST::VarDeclStmt*) override;
+        virtual void visit(AST::ArrayDeclStmt*) override;
+        virtual void visit(AST::PrintStmt* stmt) override;
+        virtual void visit(AST::IfStmt*) override;
+        virtual void visit(AST::WhileStmt*) override;
+        virtual void visit(AST::ForStmt*) override;
+        virtual void visit(AST::ReturnStmt*) override;
+        virtual void visit(AST::AbortStmt*) override;
+        virtual void visit(AST::ArrayAssignment*) override;
+        virtual void visit(AST::VarAssignment*) override;
+
+        virtual void visit(AST::BaseExpr*) override;
+        virtual void visit(AST::TrueExpr*) override;
+        virtual void visit(AST::FalseExpr*) override;
+        virtual void visit(AST::NumExpr*) override;
+        virtual void visit(AST::IdExpr*) override;
+        virtual void visit(AST::LiteralExpr*) override;
+        virtual void visit(AST::StringLiteralExpr*) override;
+        virtual void visit(AST::TernaryExpr*) override;
+        virtual void visit(AST::BinopExpr*) override;
+        virtual void visit(AST::UnaryExpr*) override;
+        virtual void visit(AST::SizeofExpr*) override;
+        virtual void visit(AST::InputExpr*) override;
+        virtual void visit(AST::ArrayExpr*) override;
+        virtual void visit(AST::FnCallExpr*) override;
+
+        virtual void visit(AST::Program*) override;
+
+        // functions of up to this many statements and expressions calling no
+        // other are inlined, set with --inline-limit; 0 turns it off
+        static unsigned inlineLimit();
+
+        void printStats(std::ostream& out) const;
+    };
+
+    // Finds the calls in tail position, see AST::TailCall: those returned
+    // right away, with no array of the function alive to be released after
+    // the call.
+    class TailCallVisitor : public BaseVisitor {
+        AST::FunctionDefinition* _fnDef = nullptr;
+        // arrays declared in the blocks around the current statement
+        unsigned _liveArrays = 0;
+        unsigned _numSibling = 0;
+        unsigned _numSelf = 0;
+
+        public:
+        virtual void visit(AST::BaseStmt* stmt) { std::cout << "TailCall visitor " << std::endl; };
+        virtual void visit(AST::StmtBlockStmt* stmtBlock) override;
+        virtual void visit(AST::VarDeclStmt*) override;
+        virtual void visit(AST::ArrayDeclStmt*) override;
+        virtual void visit(AST::PrintStmt* stmt) override;
+        virtual void visit(AST::IfStmt*) override;
+        virtual void visit(AST::WhileStmt*) override;
+        virtual void visit(AST::ForStmt*) override;
+        virtual void visit(AST::ReturnStmt*) override;
+        virtual void visit(AST::AbortStmt*) override;
+        virtual void visit(AST::ArrayAssignment*) override;
+        virtual void visit(AST::VarAssignment*) override;
+
+        virtual void visit(AST::BaseExpr*) override;
+        virtual void visit(AST::TrueExpr*) override;
+        virtual void visit(AST::FalseExpr*) override;
+        virtual void visit(AST::NumExpr*) override;
+        virtual void visit(AST::IdExpr*) override;
+        virtual void visit(AST::LiteralExpr*) override;
+        virtual void visit(AST::StringLiteralExpr*) override;
+        virtual void visit(AST::TernaryExpr*) override;
+        virtual void visit(AST::BinopExpr*) override;
+        virtual void visit(AST::UnaryExpr*) override;
+        virtual void visit(AST::SizeofExpr*) override;
+        virtual void visit(AST::InputExpr*) override;
+        virtual void visit(AST::ArrayExpr*) override;
+        virtual void visit(AST::FnCallExpr*) override;
+
+        virtual void visit(AST::Program*) override;
+
+        void printStats(std::ostream& out) const;
+    };
+
      class CodegenVisitor : public BaseVisitor {
         static llvm::LLVMContext _TheContext;
         static llvm::IRBuilder<> _Builder;
         static std::unique_ptr<llvm::Module> _TheModule;
-        static std::map<std::string, llvm::AllocaInst*> _NamedValues;
+        static std::unordered_map<Symbol, llvm::AllocaInst*> _NamedValues;
 
         // holds the pointer to the current scope
         std::stack<AST::StmtBlockStmt*> _scope;
 
         // holds pointer to any array decls alongwith the scope in which it was declared
-        std::stack<std::pair<AST::StmtBlockStmt*, llvm::Value*>> _arrayDecls;
+        struct ArrayScope {
+            AST::StmtBlockStmt* scope;
+            llvm::Value* stackSave;
+            // null if the array is sure to fit on the stack
+            llvm::Value* arenaMark;
+        };
+        std::vector<ArrayScope> _arrayDecls;
+
+        // whether the index of each Hoisted access is in bounds, evaluated in
+        // front of its loop
+        std::unordered_map<AST::BaseStmt*, llvm::Value*> _hoistedChecks;
+        void hoistBoundsChecks(const ArenaArray<AST::BaseStmt*>& accesses);
+        // aborts unless `idx' is within the array at `arrayAlloca', as far as
+        // `check' says that needs checking here
+        void CreateBoundsCheck(AST::BaseStmt* access, AST::BoundsCheck check,
+                               llvm::Value* arrayAlloca, llvm::Value* idx, int line);
+        llvm::Value* CreateInBounds(llvm::Value* arrayAlloca, llvm::Value* idx);
+
+        // `base' to the power of `exp', read as unsigned, wrapping around at
+        // the width of the int type like multiplication does
+        llvm::Value* CreatePow(llvm::Value* base, llvm::Value* exp);
+        // & and | with --short-circuit: the right side is only evaluated if the
+        // left one doesn't decide the result, with a select if it's cheap
+        void CreateShortCircuit(AST::BinopExpr* expr);
+
+        // with --compact-bounds-checks, the one block of the function being
+        // generated that failing bounds checks branch to, and the source line
+        // the failing one is on
+        llvm::BasicBlock* _outOfBoundsBB = nullptr;
+        llvm::PHINode* _outOfBoundsLine = nullptr;
+        void CreateBranchToOutOfBounds(llvm::Value* inBounds, int line);
+
+        // the block after the parameters are stored of a function calling
+        // itself in tail position, which those calls jump back to
+        llvm::BasicBlock* _tailRecurseBB = nullptr;
+        std::vector<llvm::AllocaInst*> _paramAllocas;
+        // the variables declared in the function, zeroed again on every jump back
+        std::vector<llvm::AllocaInst*> _varAllocas;
+        std::vector<llvm::BranchInst*> _tailRecurseJumps;
+        void CreateSelfTailCall(AST::FnCallExpr* expr);
+
+        // with optimizations, replaces calls passing constants to functions
+        // the CallGraphVisitor picked with calls to copies made for them
+        void specializeCalls(AST::Program* program);
+
         void declareRuntimeFns();
+        void declareFunctions(AST::Program* program);
+        // returns true if the generated function is broken
+        bool generateFunction(AST::FunctionDefinition* fnDef);
 
         public:
         virtual void visit(AST::BaseStmt* stmt) { std::cout << "Typechecker visitor " << std::endl; };
@@ -216,6 +546,15 @@ namespace Visitor {
 
         virtual void visit(AST::Program*) override;
 
+        // Generates code for only `fnDefs' out of `program'. All functions get
+        // external linkage, the ones not generated are declarations.
+        void generate(AST::Program* program, const std::vector<AST::FunctionDefinition*>& fnDefs);
+
+        // Generates `i64 lilang.entry.NAME(i64* args)' calling the already
+        // generated `fnDef'; lets the interpreter call native code without knowing
+        // its signature. Returns the name of the entry point.
+        std::string generateEntryPoint(AST::FunctionDefinition* fnDef);
+
         // assumes that `val' passed to it is integer;
         // update the integer width and return a new llvm::Value*
         static llvm::Value* UpdateToIntWidth(llvm::Value* val, size_t to);
@@ -226,9 +565,77 @@ namespace Visitor {
                                                         const std::string& varName,
                                                         const Token type);
 
+        // arrays of more bytes than this are allocated in the runtime's arena
+        // instead of on the stack, set with --stack-array-limit
+        static uint64_t stackArrayLimit();
+        // whether an array of `arrSize' elements always goes on the stack
+        static bool fitsOnStack(llvm::Value* arrSize);
+
         static llvm::AllocaInst* CreateAllocaArray(llvm::Function* func,
                                                              const std::string& varName,
                                                              llvm::Value* arrSize);
         static llvm::Module* getModule() { return _TheModule.get(); }
+        // hands the module over, e.g. to the JIT; there's no module to generate into afterwards
+        static std::unique_ptr<llvm::Module> releaseModule() { return std::move(_TheModule); }
+        // starts over with an empty module
+        static void createModule(const std::string& name);
+    };
+
+    // Compiles the typechecked program to bytecode for the interpreter.
+    class BytecodeVisitor : public BaseVisitor {
+        Bytecode::Module& _module;
+        Bytecode::Function* _fn = nullptr;
+        std::unordered_map<Symbol, unsigned> _fnIndices;
+        std::unordered_map<Symbol, unsigned> _strings;
+
+        // registers of the variables in scope
+        std::unordered_map<Symbol, unsigned> _vars;
+        // registers from here on are free
+        unsigned _nextReg = 0;
+        // register holding the value of the last visited expression
+        unsigned _resultReg = 0;
+
+        unsigned newReg();
+        unsigned emitExpr(AST::BaseExpr* expr);
+        // evaluates `expr' into register `dst'
+        void emitExprInto(AST::BaseExpr* expr, unsigned dst);
+        size_t emit(Bytecode::Op op, int32_t a = 0, int32_t b = 0, int32_t c = 0);
+        size_t here() const { return _fn->code.size(); }
+        // jumps if `cond' is false; the target is patched in later
+        size_t emitJumpIfFalse(AST::BaseExpr* cond);
+        void patchTarget(size_t at, size_t target);
+
+        public:
+        explicit BytecodeVisitor(Bytecode::Module& module) : _module(module) { }
+
+        virtual void visit(AST::BaseStmt* stmt) { std::cout << "Bytecode visitor " << std::endl; };
+        virtual void visit(AST::StmtBlockStmt* stmtBlock) override;
+        virtual void visit(AST::VarDeclStmt*) override;
+        virtual void visit(AST::ArrayDeclStmt*) override;
+        virtual void visit(AST::PrintStmt* stmt) override;
+        virtual void visit(AST::IfStmt*) override;
+        virtual void visit(AST::WhileStmt*) override;
+        virtual void visit(AST::ForStmt*) override;
+        virtual void visit(AST::ReturnStmt*) override;
+        virtual void visit(AST::AbortStmt*) override;
+        virtual void visit(AST::ArrayAssignment*) override;
+        virtual void visit(AST::VarAssignment*) override;
+
+        virtual void visit(AST::BaseExpr*) override;
+        virtual void visit(AST::TrueExpr*) override;
+        virtual void visit(AST::FalseExpr*) override;
+        virtual void visit(AST::NumExpr*) override;
+        virtual void visit(AST::IdExpr*) override;
+        virtual void visit(AST::LiteralExpr*) override;
+        virtual void visit(AST::StringLiteralExpr*) override;
+        virtual void visit(AST::TernaryExpr*) override;
+        virtual void visit(AST::BinopExpr*) override;
+        virtual void visit(AST::UnaryExpr*) override;
+        virtual void visit(AST::SizeofExpr*) override;
+        virtual void visit(AST::InputExpr*) override;
+        virtual void visit(AST::ArrayExpr*) override;
+        virtual void visit(AST::FnCallExpr*) override;
+
+        virtual void visit(AST::Program*) override;
     };
-}
\ No newline at end of file
+}